@@ -5,5 +5,13 @@ LOCAL_MODULE    := JVideoOut
 LOCAL_MODULE_PATH := $(LOCAL_PATH)
 LOCAL_SRC_FILES := $(wildcard *.c opengl/*.c)
 LOCAL_CFLAGS    := -Wall -std=gnu99
+ifeq ($(TARGET_ARCH_ABI),armeabi-v7a)
+# only the neon compare and halve kernels need neon, they are picked at runtime
+LOCAL_SRC_FILES := $(filter-out opengl/copy_neon.c,$(LOCAL_SRC_FILES)) opengl/copy_neon.c.neon
+LOCAL_CFLAGS    += -DCAN_COMPILE_ARM_NEON
+LOCAL_STATIC_LIBRARIES := cpufeatures
+endif
 #LOCAL_LDLIBS    := -llog -landroid -lEGL -lGLESv2
 include $(BUILD_STATIC_LIBRARY)
+
+$(call import-module,android/cpufeatures)
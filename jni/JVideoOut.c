@@ -1,4 +1,5 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <malloc.h>
 #include <string.h>
 
@@ -15,6 +16,15 @@ typedef struct
 	int		height;
 }vo_rect;
 
+/* last frames of one render stage */
+#define VO_TIMING_WINDOW 128
+typedef struct
+{
+	int		sample[VO_TIMING_WINDOW];
+	int		count;
+	int		index;
+}vo_timing;
+
 typedef struct _VO_HANDLE_
 {
 	EGL_HANDLE 		egl;
@@ -22,6 +32,12 @@ typedef struct _VO_HANDLE_
 	vo_rect			set_rect;
 	vo_rect			default_rect;
 	int				brect;
+	int				view_dirty;		/* set_rect changed, or no view set yet */
+	VO_STATS		stats;
+	vo_timing		upload_timing;
+	vo_timing		draw_timing;
+	vo_timing		swap_timing;
+	vo_timing		gpu_timing;
 }VO_HANDLE, *PVO_HANDLE;
 
 
@@ -31,11 +47,13 @@ JVO_HANDLE JVO_Open(void* NativeWindow)
 	EGL_HANDLE 			egl 	= NULL;
 	OPENGL_HANDLE		opengl  = NULL;
 
+#ifdef __ANDROID__
 	if (NativeWindow == NULL)
 	{
 		LOGI("NativeWindow == NULL");
 		goto fail;
 	}
+#endif
 
 	vo = malloc(sizeof(VO_HANDLE));
 	if (vo == NULL)
@@ -44,6 +62,9 @@ JVO_HANDLE JVO_Open(void* NativeWindow)
 	}
 
 	memset(vo, 0, sizeof(VO_HANDLE));
+	vo->stats.i_gpu_us = -1;
+	vo->stats.i_gl_calls = -1;
+	vo->view_dirty = 1;
 
 	egl = egl_open(NativeWindow);
 	if (egl == NULL)
@@ -95,32 +116,18 @@ void JVO_Close(JVO_HANDLE h)
 	LOGI("JVO_Close success");
 }
 
-int JVO_Render(JVO_HANDLE h, PVO_IN_YUV pic)
+/* Follow the surface size or the viewport set by JVO_ViewPort */
+static void vo_update_view(PVO_HANDLE vo, int width, int height)
 {
 	int left = 0;
 	int top = 0;
-	int width = 0;
- 	int height = 0;
-
-	PVO_HANDLE vo = h;
-
-	if (vo == NULL)
-	{
-		return -1;
-	}
-
-	egl_query_surface(vo->egl, &width, &height);
-
-	pic->i_visible_width = width;
-	pic->i_visible_height = height;
-	opengl_do(vo->opengl, pic);
 
-	
 	if ((vo->default_rect.width != width) || (vo->default_rect.height != height) || 
-		vo->brect != 0)
+		vo->view_dirty != 0)
 	{
 		vo->default_rect.width = width;
 		vo->default_rect.height = height;
+		vo->view_dirty = 0;
 		if (vo->brect != 0)
 		{
 			left = vo->set_rect.left;
@@ -134,14 +141,319 @@ int JVO_Render(JVO_HANDLE h, PVO_IN_YUV pic)
 // 			height = 100;
 		}
 
-		opengl_set_view(left, top, width, height);
+		opengl_set_view(vo->opengl, left, top, width, height,
+						vo->default_rect.width, vo->default_rect.height);
 
 		LOGI("JVO_Render: width: %d, height: %d", width, height);
 
 	}
+}
+
+static void vo_timing_add(vo_timing *t, int us)
+{
+	t->sample[t->index] = us;
+	t->index = (t->index + 1) % VO_TIMING_WINDOW;
+	if (t->count < VO_TIMING_WINDOW)
+	{
+		t->count++;
+	}
+}
 
+static int vo_timing_cmp(const void *a, const void *b)
+{
+	return *(const int *)a - *(const int *)b;
+}
+
+static void vo_timing_get(const vo_timing *t, PVO_TIMING timing)
+{
+	int sorted[VO_TIMING_WINDOW];
+	int64_t sum = 0;
+	int i;
+
+	memset(timing, 0, sizeof(VO_TIMING));
+	if (t->count == 0)
+	{
+		return;
+	}
+
+	memcpy(sorted, t->sample, t->count * sizeof(int));
+	qsort(sorted, t->count, sizeof(int), vo_timing_cmp);
+	for (i = 0; i < t->count; i++)
+	{
+		sum += sorted[i];
+	}
+
+	timing->i_samples = t->count;
+	timing->i_min_us = sorted[0];
+	timing->i_avg_us = (int)(sum / t->count);
+	timing->i_p99_us = sorted[(t->count * 99 + 99) / 100 - 1];
+}
+
+/* Swap and account the frame started at start */
+/* redraw: nothing was uploaded, the upload figures stay those of the last
+ * frame */
+static void vo_end_frame(PVO_HANDLE vo, int64_t start, int redraw)
+{
+	int render_us;
+	int64_t swap_start;
+	VO_STATS stats;
+
+	swap_start = opengl_mdate();
 	egl_do(vo->egl);
 
+	memset(&stats, 0, sizeof(stats));
+	opengl_get_stats(vo->opengl, &stats);
+	stats.i_swap_us = (int)(opengl_mdate() - swap_start);
+	render_us = (int)(opengl_mdate() - start) - stats.i_upload_us;
+
+	if (!redraw)
+	{
+		vo_timing_add(&vo->upload_timing, stats.i_upload_us);
+	}
+	vo_timing_add(&vo->draw_timing, stats.i_draw_us);
+	vo_timing_add(&vo->swap_timing, stats.i_swap_us);
+	if (stats.i_gpu_us >= 0)
+	{
+		vo_timing_add(&vo->gpu_timing, stats.i_gpu_us);
+		vo->stats.i_gpu_us = stats.i_gpu_us;
+	}
+
+	if (vo->stats.i_frames == 0)
+	{
+		vo->stats.i_upload_avg_us = stats.i_upload_us;
+		vo->stats.i_render_avg_us = render_us;
+	}
+	vo->stats.i_frames++;
+	if (redraw)
+	{
+		vo->stats.i_redraws++;
+	}
+	else
+	{
+		vo->stats.i_upload_us = stats.i_upload_us;
+		vo->stats.i_upload_avg_us += (stats.i_upload_us - vo->stats.i_upload_avg_us) / 16;
+		vo->stats.i_upload_bytes = stats.i_upload_bytes;
+	}
+	vo->stats.i_render_us = render_us;
+	vo->stats.i_render_avg_us += (render_us - vo->stats.i_render_avg_us) / 16;
+	vo->stats.i_pbo_count = stats.i_pbo_count;
+	vo->stats.i_texture_count = stats.i_texture_count;
+	vo->stats.i_draw_us = stats.i_draw_us;
+	vo->stats.i_swap_us = stats.i_swap_us;
+	vo->stats.i_gl_calls = stats.i_gl_calls;
+}
+
+int JVO_Render(JVO_HANDLE h, PVO_IN_YUV pic)
+{
+	int width = 0;
+ 	int height = 0;
+	int ret;
+
+	int64_t start;
+
+	PVO_HANDLE vo = h;
+
+	if (vo == NULL)
+	{
+		return -1;
+	}
+
+	egl_query_surface(vo->egl, &width, &height);
+
+	/* size of the view, the decimation of large pictures follows it */
+	pic->i_visible_width = vo->brect ? vo->set_rect.width : width;
+	pic->i_visible_height = vo->brect ? vo->set_rect.height : height;
+
+	/* the view is set first, the background clear depends on it */
+	vo_update_view(vo, width, height);
+
+	start = opengl_mdate();
+	ret = opengl_do(vo->opengl, pic);
+	if (ret > 0)
+	{
+		vo_end_frame(vo, start, 0);
+	}
+
+	return ret;
+}
+
+int JVO_RenderImage(JVO_HANDLE h, PVO_IN_IMAGE img)
+{
+	int width = 0;
+ 	int height = 0;
+	int owned = 0;
+	int ret;
+
+	int64_t start;
+	void *image;
+
+	PVO_HANDLE vo = h;
+
+	if ((vo == NULL) || (img == NULL))
+	{
+		return -1;
+	}
+
+	egl_query_surface(vo->egl, &width, &height);
+	vo_update_view(vo, width, height);
+
+	start = opengl_mdate();
+
+	image = egl_image_import(vo->egl, img, &owned);
+	if (image == NULL)
+	{
+		return -1;
+	}
+
+	ret = opengl_do_image(vo->opengl, image, img->i_width, img->i_height);
+	if (ret > 0)
+	{
+		vo_end_frame(vo, start, 0);
+	}
+
+	/* the texture keeps the storage of a released image */
+	if (owned)
+	{
+		egl_image_release(vo->egl, image);
+	}
+
+	return ret;
+}
+
+int JVO_Redraw(JVO_HANDLE h)
+{
+	int width = 0;
+	int height = 0;
+	int ret;
+
+	int64_t start;
+
+	PVO_HANDLE vo = h;
+
+	if (vo == NULL)
+	{
+		return -1;
+	}
+
+	/* a resize since the last frame applies too */
+	egl_query_surface(vo->egl, &width, &height);
+	vo_update_view(vo, width, height);
+
+	start = opengl_mdate();
+	ret = opengl_redraw(vo->opengl);
+	if (ret > 0)
+	{
+		vo_end_frame(vo, start, 1);
+	}
+
+	return ret;
+}
+
+int JVO_SetProgramCache(const char *dir)
+{
+	return opengl_set_program_cache(dir);
+}
+
+int JVO_SetPbo(JVO_HANDLE h, int count)
+{
+	PVO_HANDLE vo = h;
+
+	if (vo == NULL)
+	{
+		return -1;
+	}
+
+	return opengl_set_pbo(vo->opengl, count);
+}
+
+int JVO_SetTextureCount(JVO_HANDLE h, int count)
+{
+	PVO_HANDLE vo = h;
+
+	if (vo == NULL)
+	{
+		return -1;
+	}
+
+	return opengl_set_texture_count(vo->opengl, count);
+}
+
+int JVO_SetDirtyUpload(JVO_HANDLE h, int band_height)
+{
+	PVO_HANDLE vo = h;
+
+	if (vo == NULL)
+	{
+		return -1;
+	}
+
+	return opengl_set_dirty_upload(vo->opengl, band_height);
+}
+
+int JVO_SetDecimation(JVO_HANDLE h, int max_factor)
+{
+	PVO_HANDLE vo = h;
+
+	if (vo == NULL)
+	{
+		return -1;
+	}
+
+	return opengl_set_decimation(vo->opengl, max_factor);
+}
+
+int JVO_SetScaleQuality(JVO_HANDLE h, int quality)
+{
+	PVO_HANDLE vo = h;
+
+	if (vo == NULL)
+	{
+		return -1;
+	}
+
+	return opengl_set_scale_quality(vo->opengl, quality);
+}
+
+int JVO_SetDirtyRects(JVO_HANDLE h, const VO_RECT *rects, int count)
+{
+	PVO_HANDLE vo = h;
+
+	if (vo == NULL)
+	{
+		return -1;
+	}
+
+	return opengl_set_dirty_rects(vo->opengl, rects, count);
+}
+
+int JVO_GetStats(JVO_HANDLE h, PVO_STATS stats)
+{
+	PVO_HANDLE vo = h;
+
+	if ((vo == NULL) || (stats == NULL))
+	{
+		return -1;
+	}
+
+	*stats = vo->stats;
+
+	return 1;
+}
+
+int JVO_GetTimings(JVO_HANDLE h, PVO_TIMINGS timings)
+{
+	PVO_HANDLE vo = h;
+
+	if ((vo == NULL) || (timings == NULL))
+	{
+		return -1;
+	}
+
+	vo_timing_get(&vo->upload_timing, &timings->upload);
+	vo_timing_get(&vo->draw_timing, &timings->draw);
+	vo_timing_get(&vo->swap_timing, &timings->swap);
+	vo_timing_get(&vo->gpu_timing, &timings->gpu);
+
 	return 1;
 }
 
@@ -169,6 +481,42 @@ int JVO_SetScale(JVO_HANDLE h, float scale, float x1, float y1, float x2, float
 	return opengl_set_scale(vo->opengl, scale, x1, y1, x2, y2, vo->default_rect.width, vo->default_rect.height);
 }
 
+int JVO_SetTransform(JVO_HANDLE h, const float *matrix)
+{
+	PVO_HANDLE vo = h;
+
+	if (vo == NULL)
+	{
+		return -1;
+	}
+
+	return opengl_set_transform(vo->opengl, matrix);
+}
+
+int JVO_SetOrientation(JVO_HANDLE h, int degrees, int mirror)
+{
+	PVO_HANDLE vo = h;
+
+	if (vo == NULL)
+	{
+		return -1;
+	}
+
+	return opengl_set_orientation(vo->opengl, degrees, mirror);
+}
+
+int JVO_SetDisplayMode(JVO_HANDLE h, int mode)
+{
+	PVO_HANDLE vo = h;
+
+	if (vo == NULL)
+	{
+		return -1;
+	}
+
+	return opengl_set_display_mode(vo->opengl, mode);
+}
+
 int JVO_SetOffset(JVO_HANDLE h, int off_x, int off_y)
 {
 	PVO_HANDLE vo = h;
@@ -190,7 +538,10 @@ int JVO_ClearColor(JVO_HANDLE h, float red, float green, float blue, float alpha
 		return -1;
 	}
 
-	opengl_clearcolor(red, green, blue, alpha);
+	if (opengl_clearcolor(vo->opengl, red, green, blue, alpha) < 0)
+	{
+		return -1;
+	}
 	egl_do(vo->egl);
 
 	return 1;
@@ -212,6 +563,7 @@ int JVO_ViewPort(JVO_HANDLE h, int x, int y, int width,int height)
 	vo->set_rect.width = width;
 	vo->set_rect.height = height;
 	vo->brect = 1;
+	vo->view_dirty = 1;
 
 // 	opengl_set_view(x, y, width, height);
 // 	egl_do(vo->egl);
@@ -22,21 +22,123 @@ typedef struct
     int             i_pitch;  // y/u/v pitch
 }VO_PLANE;
 
+// i_chroma values, the fourcc of the input layout
+#define JVO_FOURCC(a, b, c, d) \
+    ((unsigned int)(a) | ((unsigned int)(b) << 8) | \
+     ((unsigned int)(c) << 16) | ((unsigned int)(d) << 24))
+#define JVO_CHROMA_I420 JVO_FOURCC('I','4','2','0') // p[0] y, p[1] u, p[2] v
+#define JVO_CHROMA_YV12 JVO_FOURCC('Y','V','1','2') // p[0] y, p[1] v, p[2] u
+#define JVO_CHROMA_NV12 JVO_FOURCC('N','V','1','2') // p[0] y, p[1] interleaved u/v
+#define JVO_CHROMA_NV21 JVO_FOURCC('N','V','2','1') // p[0] y, p[1] interleaved v/u
+#define JVO_CHROMA_YUY2 JVO_FOURCC('Y','U','Y','2') // p[0] packed y0 u y1 v
+#define JVO_CHROMA_YVYU JVO_FOURCC('Y','V','Y','U') // p[0] packed y0 v y1 u
+#define JVO_CHROMA_UYVY JVO_FOURCC('U','Y','V','Y') // p[0] packed u y0 v y1
+#define JVO_CHROMA_VYUY JVO_FOURCC('V','Y','U','Y') // p[0] packed v y0 u y1
+#define JVO_CHROMA_I420_10L JVO_FOURCC('I','0','A','L') // y/u/v, 16 bit little endian, 10 bits used
+#define JVO_CHROMA_I420_9L  JVO_FOURCC('I','0','9','L') // y/u/v, 16 bit little endian, 9 bits used
+
+// VO_IN_YUV.i_matrix, yuv to rgb matrix of the stream
+#define JVO_MATRIX_AUTO     0 // BT.709 above 576 lines, BT.601 otherwise
+#define JVO_MATRIX_BT601    1
+#define JVO_MATRIX_BT709    2
+#define JVO_MATRIX_BT2020   3 // non constant luminance
+
+// VO_IN_YUV.i_range, range of the samples
+#define JVO_RANGE_AUTO      0 // full for J420 (jpeg), limited otherwise
+#define JVO_RANGE_LIMITED   1 // y 16..235, u/v 16..240
+#define JVO_RANGE_FULL      2 // 0..255
+
+// JVO_SetDisplayMode modes, how the picture is placed in the view
+#define JVO_DISPLAY_STRETCH 0 // fills the view, the aspect ratio is not kept
+#define JVO_DISPLAY_FIT     1 // whole picture, bars around it
+#define JVO_DISPLAY_FILL    2 // fills the view, the picture is cropped
+#define JVO_DISPLAY_NATIVE  3 // 1:1 pixels, centered, cropped when larger
+
+// JVO_SetScaleQuality values
+#define JVO_SCALE_QUALITY_BILINEAR 0 // bilinear at any size
+#define JVO_SCALE_QUALITY_AUTO     1 // mipmaps or bicubic when the picture is shrunk
+
 // vo in
 typedef struct
 {
     VO_PLANE        p[4];     // y/u/v
-    unsigned int    i_chroma; // yuv format not used!
+    unsigned int    i_chroma; // JVO_CHROMA_*, 0 or unknown: JVO_CHROMA_YV12
     unsigned int    i_width;  // y width
     unsigned int    i_height; // u width
 	int i_visible_width;                 /**< width of visible area */
     int i_visible_height;               /**< height of visible area */
+    int             i_matrix; // JVO_MATRIX_*, a change only reloads the shader coefficients
+    int             i_range;  // JVO_RANGE_*
 }VO_IN_YUV, *PVO_IN_YUV;
 
+// dma-buf plane
+typedef struct
+{
+    int             i_fd;     // dma-buf file descriptor, kept open by the caller
+    int             i_offset; // plane start in the buffer
+    int             i_pitch;  // plane pitch
+}VO_DMABUF_PLANE;
+
+// vo image in, sampled in place without any copy
+typedef struct
+{
+    void *          p_image;       // EGLImageKHR, or NULL to import the dma-buf planes
+    VO_DMABUF_PLANE p[3];          // dma-buf planes
+    int             i_plane_count; // dma-buf plane count
+    unsigned int    i_fourcc;      // DRM_FORMAT_* of the dma-buf (NV12, YUV420...)
+    unsigned int    i_width;
+    unsigned int    i_height;
+}VO_IN_IMAGE, *PVO_IN_IMAGE;
+
+// rect, in luma pixels
+typedef struct
+{
+    int             x;
+    int             y;
+    int             width;
+    int             height;
+}VO_RECT, *PVO_RECT;
+
+// vo statistics, times in microseconds
+typedef struct
+{
+    unsigned int    i_frames;         // frames rendered
+    int             i_upload_us;      // last frame texture upload time
+    int             i_render_us;      // last frame draw + swap time
+    int             i_upload_avg_us;  // smoothed upload time
+    int             i_render_avg_us;  // smoothed draw + swap time
+    int             i_pbo_count;      // pbo ring depth in use, 0: direct upload
+    int             i_texture_count;  // texture sets uploads rotate through
+    int             i_upload_bytes;   // bytes sent to the textures by the last frame
+    int             i_draw_us;        // last frame clear + draw calls time
+    int             i_swap_us;        // last frame eglSwapBuffers time
+    int             i_gpu_us;         // gpu upload + draw time of the last measured frame, -1: unknown
+    int             i_gl_calls;       // gl calls of the last frame, texture and program builds included, debug builds only, -1 otherwise
+    unsigned int    i_redraws;        // frames drawn again by JVO_Redraw, counted in i_frames too
+}VO_STATS, *PVO_STATS;
+
+// timings of one render stage over the last frames, in microseconds
+typedef struct
+{
+    unsigned int    i_samples;        // frames measured, 0: no data
+    int             i_min_us;
+    int             i_avg_us;
+    int             i_p99_us;
+}VO_TIMING, *PVO_TIMING;
+
+typedef struct
+{
+    VO_TIMING       upload;           // picture conversion and texture upload
+    VO_TIMING       draw;             // clear and draw calls
+    VO_TIMING       swap;             // eglSwapBuffers
+    VO_TIMING       gpu;              // gpu time of upload + draw, needs EXT_disjoint_timer_query
+}VO_TIMINGS, *PVO_TIMINGS;
+
 /*****************************************************************************
  *JVO_Open:
  *Create an vo instance.
- *In:     void* NativeWindow // NativeWindow = ANativeWindow_fromSurface
+ *In:     void* NativeWindow // NativeWindow = ANativeWindow_fromSurface,
+ *                              // NULL off Android: a 256x256 pbuffer, for tests
  *return: return a handle to the newly-created instance, or NULL if an error 	  
 *****************************************************************************/
 JVO_HANDLE JVO_Open(void* NativeWindow);
@@ -45,11 +147,37 @@ JVO_HANDLE JVO_Open(void* NativeWindow);
  *JVO_Render:
  *displays a frame of yuv420p image
  *In:    JVO_HANDLE h
- *In:    PVO_IN_YUV pic  // yuv420p input
+ *In:    PVO_IN_YUV pic  // yuv420p input, planar or semi-planar (pic->i_chroma)
 *Return: return 1, if successful, or < 0 if an error occurred 	  
 *****************************************************************************/
 int JVO_Render(JVO_HANDLE h, PVO_IN_YUV pic);
 
+/*****************************************************************************
+ *JVO_RenderImage:
+ *displays a frame the decoder left in an EGLImage or in dma-buf memory,
+ *needs GL_OES_EGL_image_external (and EGL_EXT_image_dma_buf_import for fds)
+ *In:    JVO_HANDLE h
+ *In:    PVO_IN_IMAGE img // image created on the display of the vo, or dma-buf
+*Return: return 1, if successful, or < 0 if an error occurred
+*****************************************************************************/
+int JVO_RenderImage(JVO_HANDLE h, PVO_IN_IMAGE img);
+
+/*****************************************************************************
+ *JVO_Redraw:
+ *displays the last frame again from the textures it was uploaded to, with
+ *the current scale, transform and view, e.g. during a pinch zoom or while
+ *paused. Must be called from the thread of JVO_Render, the EGL context is
+ *current there only. From the first call on, a zoomed-in JVO_Render
+ *uploads the whole picture rather than its visible part, so that a redraw
+ *zoomed out or panned never shows texels of an older frame. An app whose
+ *first redraw may follow a zoomed-in frame (a pause) calls it once after
+ *JVO_Open: it fails with no frame yet but still takes effect.
+ *In:    JVO_HANDLE h
+*Return: return 1, if successful, or < 0 if an error occurred or no frame
+ *        was rendered yet
+*****************************************************************************/
+int JVO_Redraw(JVO_HANDLE h);
+
 /*****************************************************************************
  *JVO_Close:
  *Destroy a vo instance.
@@ -78,6 +206,139 @@ int JVO_ClearColor(JVO_HANDLE h,
 int JVO_ViewPort(JVO_HANDLE h, int x, int y, int width, int height);
 
 
+/*****************************************************************************
+ *JVO_SetProgramCache:
+ *keep the linked shader programs in dir, where the driver supports program
+ *binaries, so the next views skip compiling. Files of another driver or
+ *build are rebuilt. Applies to every vo of the process, call before JVO_Open.
+ *in:     dir // writable directory (e.g. the cache dir of the app), NULL: off
+ *Return: return 1, if successful, or < 0 if an error occurred
+*****************************************************************************/
+int JVO_SetProgramCache(const char *dir);
+
+/*****************************************************************************
+ *JVO_SetPbo:
+ *upload frames through a ring of pixel buffer objects (needs GLES3),
+ *the copy of the next frame then overlaps with the GPU reading the last one
+ *In:     JVO_HANDLE h
+ *in:     count // ring depth 0..4, 0 uploads directly from the frame (default)
+ *Return: return 1, if successful, or < 0 if an error occurred
+*****************************************************************************/
+int JVO_SetPbo(JVO_HANDLE h, int count);
+
+/*****************************************************************************
+ *JVO_SetTextureCount:
+ *number of texture sets the frames rotate through, so that an upload never
+ *targets a texture the GPU may still be drawing from
+ *In:     JVO_HANDLE h
+ *in:     count // 1..3, default 2
+ *Return: return 1, if successful, or < 0 if an error occurred
+*****************************************************************************/
+int JVO_SetTextureCount(JVO_HANDLE h, int count);
+
+/*****************************************************************************
+ *JVO_SetDecimation:
+ *box filter planar 4:2:0 pictures down on the cpu before the upload when
+ *they are at least 2x (or 4x) larger than the view, a 1080p stream in a
+ *small tile then sends 4-16x less data and aliases less. The factor follows
+ *the view on each frame. Off by default, the output is box filtered once on.
+ *In:     JVO_HANDLE h
+ *in:     max_factor // 1: off (default), 2 or 4: largest factor used
+ *Return: return 1, if successful, or < 0 if an error occurred
+*****************************************************************************/
+int JVO_SetDecimation(JVO_HANDLE h, int max_factor);
+
+/*****************************************************************************
+ *JVO_SetScaleQuality:
+ *filtering of the luma of shrunk pictures. Auto follows the picture to
+ *view ratio: trilinear mipmaps above 2x (a 4k stream in a mosaic tile no
+ *longer shimmers), a bicubic b-spline from 1x to 2x, bilinear otherwise.
+ *In:     JVO_HANDLE h
+ *in:     quality // JVO_SCALE_QUALITY_*, JVO_SCALE_QUALITY_BILINEAR by default
+ *Return: return 1, if successful, or < 0 if an error occurred
+*****************************************************************************/
+int JVO_SetScaleQuality(JVO_HANDLE h, int quality);
+
+/*****************************************************************************
+ *JVO_SetDirtyUpload:
+ *only upload the horizontal bands of a frame that changed since the frame
+ *already in the textures, for mostly static scenes. Changes are found by
+ *comparing with the last frame unless JVO_SetDirtyRects gives them.
+ *In:     JVO_HANDLE h
+ *in:     band_height // luma rows per band, rounded up to 16, 0: off (default)
+ *Return: return 1, if successful, or < 0 if an error occurred
+*****************************************************************************/
+int JVO_SetDirtyUpload(JVO_HANDLE h, int band_height);
+
+/*****************************************************************************
+ *JVO_SetDirtyRects:
+ *rects of the next frame that changed, the next JVO_Render then skips the
+ *comparison. Call it from the rendering thread, before JVO_Render.
+ *In:     JVO_HANDLE h
+ *in:     rects, count // count == 0: nothing changed
+ *Return: return 1, if successful, or < 0 if an error occurred
+*****************************************************************************/
+int JVO_SetDirtyRects(JVO_HANDLE h, const VO_RECT *rects, int count);
+
+/*****************************************************************************
+ *JVO_GetStats:
+ *get the upload and render times of the instance
+ *In:     JVO_HANDLE h
+ *Out:    PVO_STATS stats
+ *Return: return 1, if successful, or < 0 if an error occurred
+*****************************************************************************/
+int JVO_GetStats(JVO_HANDLE h, PVO_STATS stats);
+
+/*****************************************************************************
+ *JVO_GetTimings:
+ *min, average and 99th percentile of each render stage over the last 128
+ *frames, to tell whether a late frame waited on the upload, the draw or the
+ *swap. Gpu times are read back a few frames late and only when the driver
+ *has EXT_disjoint_timer_query.
+ *In:     JVO_HANDLE h
+ *Out:    PVO_TIMINGS timings
+ *Return: return 1, if successful, or < 0 if an error occurred
+*****************************************************************************/
+int JVO_GetTimings(JVO_HANDLE h, PVO_TIMINGS timings);
+
+/*****************************************************************************
+ *JVO_SetTransform:
+ *place the picture with one 3x3 matrix applied to the full view quad in
+ *normalized device coordinates (x right, y up, the view spans -1..1).
+ *Scale, pan, rotation and mirror are all cheap, only the part of the
+ *picture left on screen is uploaded. Resets the zoom of JVO_SetScale, the
+ *next pinch zooms and pans the transformed picture.
+ *e.g. zoom 2x on the center: { 2,0,0, 0,2,0, 0,0,1 },
+ *     mirror: { -1,0,0, 0,1,0, 0,0,1 }, 90 ccw: { 0,1,0, -1,0,0, 0,0,1 }
+ *In:     JVO_HANDLE h
+ *in:     matrix // column major, as glUniformMatrix3fv, NULL: identity
+ *Return: return 1, if successful, or < 0 if an error occurred
+*****************************************************************************/
+int JVO_SetTransform(JVO_HANDLE h, const float *matrix);
+
+/*****************************************************************************
+ *JVO_SetOrientation:
+ *orientation of the camera, for corridor (90/270) or ceiling (180) mounts.
+ *Applied by the vertex shader, no per frame cost; the display mode places
+ *the turned picture and JVO_SetScale/JVO_SetTransform stay in view space.
+ *In:     JVO_HANDLE h
+ *in:     degrees // clockwise rotation: 0 (default), 90, 180 or 270
+ *in:     mirror  // 1: flip left to right before the rotation
+ *Return: return 1, if successful, or < 0 if an error occurred
+*****************************************************************************/
+int JVO_SetOrientation(JVO_HANDLE h, int degrees, int mirror);
+
+/*****************************************************************************
+ *JVO_SetDisplayMode:
+ *place the picture in the view (the surface or the JVO_ViewPort rect) with
+ *its aspect ratio. The viewport is worked out again only when the surface,
+ *the view or the picture size changes. JVO_SetTransform applies on top.
+ *In:     JVO_HANDLE h
+ *in:     mode // JVO_DISPLAY_*, JVO_DISPLAY_STRETCH by default
+ *Return: return 1, if successful, or < 0 if an error occurred
+*****************************************************************************/
+int JVO_SetDisplayMode(JVO_HANDLE h, int mode);
+
 int JVO_SetOffset(JVO_HANDLE h, int off_x, int off_y);
 int JVO_SetScale(JVO_HANDLE h, float scale, float x1, float y1, float x2, float y2);
 int JVO_Scale_Before(JVO_HANDLE h, float x1, float y1, float x2, float y2);
@@ -0,0 +1,266 @@
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#if defined(__i386__) || defined(__x86_64__)
+#   define CAN_COMPILE_SSE2
+#   define CAN_COMPILE_AVX2
+#   include <immintrin.h>
+#endif
+
+#if defined(CAN_COMPILE_ARM_NEON) && !defined(__aarch64__) && defined(__ANDROID__)
+#   include <cpu-features.h>
+#endif
+
+#include "copy.h"
+#include "../log.h"
+
+static int CompareRowsC(const uint8_t *a, size_t a_pitch,
+                        const uint8_t *b, size_t b_pitch,
+                        unsigned width, unsigned height)
+{
+    for (unsigned y = 0; y < height; y++) {
+        if (memcmp(a, b, width))
+            return 1;
+        a += a_pitch;
+        b += b_pitch;
+    }
+    return 0;
+}
+
+static void HalveRowsC(uint8_t *dst, size_t dst_pitch,
+                       const uint8_t *src, size_t src_pitch,
+                       unsigned width, unsigned height)
+{
+    for (unsigned y = 0; y < height; y++) {
+        const uint8_t *s0 = src;
+        const uint8_t *s1 = src + src_pitch;
+
+        for (unsigned x = 0; x < width; x++)
+            dst[x] = (s0[2 * x] + s0[2 * x + 1] + s1[2 * x] + s1[2 * x + 1] + 2) >> 2;
+
+        src += 2 * src_pitch;
+        dst += dst_pitch;
+    }
+}
+
+#ifdef CAN_COMPILE_SSE2
+__attribute__((target("sse2")))
+static void HalveRowsSSE2(uint8_t *dst, size_t dst_pitch,
+                          const uint8_t *src, size_t src_pitch,
+                          unsigned width, unsigned height)
+{
+    const __m128i mask = _mm_set1_epi16(0x00ff);
+    const __m128i round = _mm_set1_epi16(2);
+
+    for (unsigned y = 0; y < height; y++) {
+        const uint8_t *s0 = src;
+        const uint8_t *s1 = src + src_pitch;
+        unsigned x = 0;
+
+        /* even + odd byte of each 16 bit lane is one horizontal pair */
+        for (; x + 16 <= width; x += 16) {
+            __m128i a0 = _mm_loadu_si128((const __m128i *)(s0 + 2 * x) + 0);
+            __m128i a1 = _mm_loadu_si128((const __m128i *)(s0 + 2 * x) + 1);
+            __m128i b0 = _mm_loadu_si128((const __m128i *)(s1 + 2 * x) + 0);
+            __m128i b1 = _mm_loadu_si128((const __m128i *)(s1 + 2 * x) + 1);
+            __m128i lo = _mm_add_epi16(_mm_add_epi16(_mm_and_si128(a0, mask), _mm_srli_epi16(a0, 8)),
+                                       _mm_add_epi16(_mm_and_si128(b0, mask), _mm_srli_epi16(b0, 8)));
+            __m128i hi = _mm_add_epi16(_mm_add_epi16(_mm_and_si128(a1, mask), _mm_srli_epi16(a1, 8)),
+                                       _mm_add_epi16(_mm_and_si128(b1, mask), _mm_srli_epi16(b1, 8)));
+            lo = _mm_srli_epi16(_mm_add_epi16(lo, round), 2);
+            hi = _mm_srli_epi16(_mm_add_epi16(hi, round), 2);
+            _mm_storeu_si128((__m128i *)(dst + x), _mm_packus_epi16(lo, hi));
+        }
+        for (; x < width; x++)
+            dst[x] = (s0[2 * x] + s0[2 * x + 1] + s1[2 * x] + s1[2 * x + 1] + 2) >> 2;
+
+        src += 2 * src_pitch;
+        dst += dst_pitch;
+    }
+}
+
+__attribute__((target("sse2")))
+static int CompareRowsSSE2(const uint8_t *a, size_t a_pitch,
+                           const uint8_t *b, size_t b_pitch,
+                           unsigned width, unsigned height)
+{
+    for (unsigned y = 0; y < height; y++) {
+        __m128i acc = _mm_setzero_si128();
+        unsigned x = 0;
+
+        for (; x + 64 <= width; x += 64) {
+            __m128i x0 = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(a + x) + 0),
+                                       _mm_loadu_si128((const __m128i *)(b + x) + 0));
+            __m128i x1 = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(a + x) + 1),
+                                       _mm_loadu_si128((const __m128i *)(b + x) + 1));
+            __m128i x2 = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(a + x) + 2),
+                                       _mm_loadu_si128((const __m128i *)(b + x) + 2));
+            __m128i x3 = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(a + x) + 3),
+                                       _mm_loadu_si128((const __m128i *)(b + x) + 3));
+            acc = _mm_or_si128(acc, _mm_or_si128(_mm_or_si128(x0, x1), _mm_or_si128(x2, x3)));
+        }
+        for (; x + 16 <= width; x += 16)
+            acc = _mm_or_si128(acc, _mm_xor_si128(_mm_loadu_si128((const __m128i *)(a + x)),
+                                                  _mm_loadu_si128((const __m128i *)(b + x))));
+
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(acc, _mm_setzero_si128())) != 0xFFFF)
+            return 1;
+        if (x < width && memcmp(a + x, b + x, width - x))
+            return 1;
+
+        a += a_pitch;
+        b += b_pitch;
+    }
+    return 0;
+}
+
+#endif
+
+#ifdef CAN_COMPILE_AVX2
+__attribute__((target("avx2")))
+static void HalveRowsAVX2(uint8_t *dst, size_t dst_pitch,
+                          const uint8_t *src, size_t src_pitch,
+                          unsigned width, unsigned height)
+{
+    const __m256i mask = _mm256_set1_epi16(0x00ff);
+    const __m256i round = _mm256_set1_epi16(2);
+
+    for (unsigned y = 0; y < height; y++) {
+        const uint8_t *s0 = src;
+        const uint8_t *s1 = src + src_pitch;
+        unsigned x = 0;
+
+        for (; x + 32 <= width; x += 32) {
+            __m256i a0 = _mm256_loadu_si256((const __m256i *)(s0 + 2 * x) + 0);
+            __m256i a1 = _mm256_loadu_si256((const __m256i *)(s0 + 2 * x) + 1);
+            __m256i b0 = _mm256_loadu_si256((const __m256i *)(s1 + 2 * x) + 0);
+            __m256i b1 = _mm256_loadu_si256((const __m256i *)(s1 + 2 * x) + 1);
+            __m256i lo = _mm256_add_epi16(_mm256_add_epi16(_mm256_and_si256(a0, mask), _mm256_srli_epi16(a0, 8)),
+                                          _mm256_add_epi16(_mm256_and_si256(b0, mask), _mm256_srli_epi16(b0, 8)));
+            __m256i hi = _mm256_add_epi16(_mm256_add_epi16(_mm256_and_si256(a1, mask), _mm256_srli_epi16(a1, 8)),
+                                          _mm256_add_epi16(_mm256_and_si256(b1, mask), _mm256_srli_epi16(b1, 8)));
+            lo = _mm256_srli_epi16(_mm256_add_epi16(lo, round), 2);
+            hi = _mm256_srli_epi16(_mm256_add_epi16(hi, round), 2);
+            /* packus works per 128 bit lane, put the quadwords back in order */
+            _mm256_storeu_si256((__m256i *)(dst + x),
+                                _mm256_permute4x64_epi64(_mm256_packus_epi16(lo, hi), 0xd8));
+        }
+        for (; x < width; x++)
+            dst[x] = (s0[2 * x] + s0[2 * x + 1] + s1[2 * x] + s1[2 * x + 1] + 2) >> 2;
+
+        src += 2 * src_pitch;
+        dst += dst_pitch;
+    }
+}
+
+__attribute__((target("avx2")))
+static int CompareRowsAVX2(const uint8_t *a, size_t a_pitch,
+                           const uint8_t *b, size_t b_pitch,
+                           unsigned width, unsigned height)
+{
+    for (unsigned y = 0; y < height; y++) {
+        __m256i acc = _mm256_setzero_si256();
+        unsigned x = 0;
+
+        for (; x + 128 <= width; x += 128) {
+            __m256i y0 = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)(a + x) + 0),
+                                          _mm256_loadu_si256((const __m256i *)(b + x) + 0));
+            __m256i y1 = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)(a + x) + 1),
+                                          _mm256_loadu_si256((const __m256i *)(b + x) + 1));
+            __m256i y2 = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)(a + x) + 2),
+                                          _mm256_loadu_si256((const __m256i *)(b + x) + 2));
+            __m256i y3 = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)(a + x) + 3),
+                                          _mm256_loadu_si256((const __m256i *)(b + x) + 3));
+            acc = _mm256_or_si256(acc, _mm256_or_si256(_mm256_or_si256(y0, y1),
+                                                       _mm256_or_si256(y2, y3)));
+        }
+        for (; x + 32 <= width; x += 32)
+            acc = _mm256_or_si256(acc, _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)(a + x)),
+                                                        _mm256_loadu_si256((const __m256i *)(b + x))));
+
+        if (!_mm256_testz_si256(acc, acc))
+            return 1;
+        if (x < width && memcmp(a + x, b + x, width - x))
+            return 1;
+
+        a += a_pitch;
+        b += b_pitch;
+    }
+    return 0;
+}
+
+#endif
+
+static compare_rows_t compare_rows = CompareRowsC;
+static halve_rows_t halve_rows = HalveRowsC;
+static pthread_once_t copy_once = PTHREAD_ONCE_INIT;
+
+static void CopyInit(void)
+{
+    const char *name = "C";
+
+#ifdef CAN_COMPILE_SSE2
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse2")) {
+        compare_rows = CompareRowsSSE2;
+        halve_rows = HalveRowsSSE2;
+        name = "SSE2";
+    }
+#endif
+#ifdef CAN_COMPILE_AVX2
+    if (__builtin_cpu_supports("avx2")) {
+        compare_rows = CompareRowsAVX2;
+        halve_rows = HalveRowsAVX2;
+        name = "AVX2";
+    }
+#endif
+#if defined(__aarch64__)
+    compare_rows = CompareRowsNEON;
+    halve_rows = HalveRowsNEON;
+    name = "NEON";
+#elif defined(CAN_COMPILE_ARM_NEON)
+# ifdef __ANDROID__
+    if (android_getCpuFamily() == ANDROID_CPU_FAMILY_ARM &&
+        (android_getCpuFeatures() & ANDROID_CPU_ARM_FEATURE_NEON))
+# endif
+    {
+        compare_rows = CompareRowsNEON;
+        halve_rows = HalveRowsNEON;
+        name = "NEON";
+    }
+#endif
+
+    LOGI("compare and halve kernels: %s", name);
+}
+
+/* A memcpy per row: the libc copy is already vectorized, and streaming
+ * stores only slow down the driver read that follows the repack */
+void CopyPlane(uint8_t *dst, size_t dst_pitch,
+               const uint8_t *src, size_t src_pitch,
+               unsigned width, unsigned height)
+{
+    for (unsigned y = 0; y < height; y++) {
+        memcpy(dst, src, width);
+        src += src_pitch;
+        dst += dst_pitch;
+    }
+}
+
+int ComparePlane(const uint8_t *a, size_t a_pitch,
+                 const uint8_t *b, size_t b_pitch,
+                 unsigned width, unsigned height)
+{
+    pthread_once(&copy_once, CopyInit);
+
+    return compare_rows(a, a_pitch, b, b_pitch, width, height);
+}
+
+void HalvePlane(uint8_t *dst, size_t dst_pitch,
+                const uint8_t *src, size_t src_pitch,
+                unsigned width, unsigned height)
+{
+    pthread_once(&copy_once, CopyInit);
+
+    halve_rows(dst, dst_pitch, src, src_pitch, width, height);
+}
@@ -0,0 +1,44 @@
+#ifndef _COPY_H
+#define _COPY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Alignment of the staging buffers handed to the copy kernels */
+#define COPY_BUFFER_ALIGN 64
+
+/* Copy height rows of width bytes between two strided planes */
+void CopyPlane(uint8_t *dst, size_t dst_pitch,
+               const uint8_t *src, size_t src_pitch,
+               unsigned width, unsigned height);
+
+/* Compare height rows of width bytes of two strided planes,
+ * return 0 when they are identical */
+int ComparePlane(const uint8_t *a, size_t a_pitch,
+                 const uint8_t *b, size_t b_pitch,
+                 unsigned width, unsigned height);
+
+/* Box filter a plane down to width x height, each output byte is the
+ * rounded average of a 2x2 block of the source */
+void HalvePlane(uint8_t *dst, size_t dst_pitch,
+                const uint8_t *src, size_t src_pitch,
+                unsigned width, unsigned height);
+
+/* Kernels, only for copy.c and copy_neon.c */
+typedef int (*compare_rows_t)(const uint8_t *a, size_t a_pitch,
+                              const uint8_t *b, size_t b_pitch,
+                              unsigned width, unsigned height);
+typedef void (*halve_rows_t)(uint8_t *dst, size_t dst_pitch,
+                             const uint8_t *src, size_t src_pitch,
+                             unsigned width, unsigned height);
+
+#if defined(__aarch64__) || defined(CAN_COMPILE_ARM_NEON)
+int CompareRowsNEON(const uint8_t *a, size_t a_pitch,
+                    const uint8_t *b, size_t b_pitch,
+                    unsigned width, unsigned height);
+void HalveRowsNEON(uint8_t *dst, size_t dst_pitch,
+                   const uint8_t *src, size_t src_pitch,
+                   unsigned width, unsigned height);
+#endif
+
+#endif // _COPY_H
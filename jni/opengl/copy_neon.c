@@ -0,0 +1,63 @@
+/* Built with -mfpu=neon on armeabi-v7a (see Android.mk), natively on arm64 */
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <string.h>
+#include <arm_neon.h>
+
+#include "copy.h"
+
+int CompareRowsNEON(const uint8_t *a, size_t a_pitch,
+                    const uint8_t *b, size_t b_pitch,
+                    unsigned width, unsigned height)
+{
+    for (unsigned y = 0; y < height; y++) {
+        uint8x16_t acc = vdupq_n_u8(0);
+        unsigned x = 0;
+
+        for (; x + 64 <= width; x += 64) {
+            uint8x16_t q0 = veorq_u8(vld1q_u8(a + x +  0), vld1q_u8(b + x +  0));
+            uint8x16_t q1 = veorq_u8(vld1q_u8(a + x + 16), vld1q_u8(b + x + 16));
+            uint8x16_t q2 = veorq_u8(vld1q_u8(a + x + 32), vld1q_u8(b + x + 32));
+            uint8x16_t q3 = veorq_u8(vld1q_u8(a + x + 48), vld1q_u8(b + x + 48));
+            acc = vorrq_u8(acc, vorrq_u8(vorrq_u8(q0, q1), vorrq_u8(q2, q3)));
+        }
+        for (; x + 16 <= width; x += 16)
+            acc = vorrq_u8(acc, veorq_u8(vld1q_u8(a + x), vld1q_u8(b + x)));
+
+        uint64x2_t acc64 = vreinterpretq_u64_u8(acc);
+        if ((vgetq_lane_u64(acc64, 0) | vgetq_lane_u64(acc64, 1)) != 0)
+            return 1;
+        if (x < width && memcmp(a + x, b + x, width - x))
+            return 1;
+
+        a += a_pitch;
+        b += b_pitch;
+    }
+    return 0;
+}
+
+void HalveRowsNEON(uint8_t *dst, size_t dst_pitch,
+                   const uint8_t *src, size_t src_pitch,
+                   unsigned width, unsigned height)
+{
+    for (unsigned y = 0; y < height; y++) {
+        const uint8_t *s0 = src;
+        const uint8_t *s1 = src + src_pitch;
+        unsigned x = 0;
+
+        /* pairwise add long: horizontal pairs, then the next row on top */
+        for (; x + 16 <= width; x += 16) {
+            uint16x8_t lo = vpaddlq_u8(vld1q_u8(s0 + 2 * x));
+            uint16x8_t hi = vpaddlq_u8(vld1q_u8(s0 + 2 * x + 16));
+            lo = vpadalq_u8(lo, vld1q_u8(s1 + 2 * x));
+            hi = vpadalq_u8(hi, vld1q_u8(s1 + 2 * x + 16));
+            vst1q_u8(dst + x, vcombine_u8(vrshrn_n_u16(lo, 2), vrshrn_n_u16(hi, 2)));
+        }
+        for (; x < width; x++)
+            dst[x] = (s0[2 * x] + s0[2 * x + 1] + s1[2 * x] + s1[2 * x + 1] + 2) >> 2;
+
+        src += 2 * src_pitch;
+        dst += dst_pitch;
+    }
+}
+
+#endif
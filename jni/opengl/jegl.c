@@ -1,6 +1,7 @@
 #include <stdio.h>
 #include <malloc.h>
 #include <string.h>
+#include <stdint.h>
 
 #define  EGL_EGLEXT_PROTOTYPES
 
@@ -10,11 +11,41 @@
 #include "../log.h"
 
 
+#ifndef EGL_OPENGL_ES3_BIT_KHR
+#define EGL_OPENGL_ES3_BIT_KHR 0x0040
+#endif
+#ifndef EGL_LINUX_DMA_BUF_EXT
+#define EGL_LINUX_DMA_BUF_EXT          0x3270
+#define EGL_LINUX_DRM_FOURCC_EXT       0x3271
+#define EGL_DMA_BUF_PLANE0_FD_EXT      0x3272
+#define EGL_DMA_BUF_PLANE0_OFFSET_EXT  0x3273
+#define EGL_DMA_BUF_PLANE0_PITCH_EXT   0x3274
+#define EGL_DMA_BUF_PLANE1_FD_EXT      0x3275
+#define EGL_DMA_BUF_PLANE1_OFFSET_EXT  0x3276
+#define EGL_DMA_BUF_PLANE1_PITCH_EXT   0x3277
+#define EGL_DMA_BUF_PLANE2_FD_EXT      0x3278
+#define EGL_DMA_BUF_PLANE2_OFFSET_EXT  0x3279
+#define EGL_DMA_BUF_PLANE2_PITCH_EXT   0x327A
+#endif
+
+/* EGL_KHR_image_base, resolved with eglGetProcAddress */
+typedef void *     (EGLAPIENTRYP PFN_veglCreateImageKHR)(EGLDisplay, EGLContext, EGLenum,
+                                                         EGLClientBuffer, const EGLint *);
+typedef EGLBoolean (EGLAPIENTRYP PFN_veglDestroyImageKHR)(EGLDisplay, void *);
+
+/* pbuffer size of a context opened without a window, desktop tests only */
+#define EGL_HEADLESS_WIDTH  256
+#define EGL_HEADLESS_HEIGHT 256
+
 typedef struct _EGL
 {
     EGLDisplay display;
     EGLSurface surface;
     EGLContext context;
+
+    int        supports_dma_buf;
+    PFN_veglCreateImageKHR  CreateImageKHR;
+    PFN_veglDestroyImageKHR DestroyImageKHR;
 }EGL, *PEGL;
 
 struct gl_api
@@ -70,19 +101,24 @@ EGL_HANDLE egl_open(void* NativeWindow)
 
 	PEGL	h = NULL;
 
-    static const struct gl_api api = {
-        "OpenGL_ES", EGL_OPENGL_ES_API, 3, EGL_OPENGL_ES2_BIT,
-        { EGL_CONTEXT_CLIENT_VERSION, 2, EGL_NONE },
+    /* GLES3 first (pixel buffer objects), GLES2 otherwise */
+    static const struct gl_api apis[] = {
+        { "OpenGL_ES", EGL_OPENGL_ES_API, 0, EGL_OPENGL_ES3_BIT_KHR,
+          { EGL_CONTEXT_CLIENT_VERSION, 3, EGL_NONE }, },
+        { "OpenGL_ES", EGL_OPENGL_ES_API, 3, EGL_OPENGL_ES2_BIT,
+          { EGL_CONTEXT_CLIENT_VERSION, 2, EGL_NONE }, },
     };
 
-    const EGLint attribs[] = {
+    EGLint attribs[] = {
         EGL_RED_SIZE, 5,
         EGL_GREEN_SIZE, 5,
         EGL_BLUE_SIZE, 5,
-        EGL_RENDERABLE_TYPE, api.render_bit,
+        EGL_RENDERABLE_TYPE, 0,
+        EGL_SURFACE_TYPE, EGL_WINDOW_BIT,
         EGL_NONE
     };
 
+    unsigned int i;
 
 
     EGLDisplay display;
@@ -90,14 +126,22 @@ EGL_HANDLE egl_open(void* NativeWindow)
     EGLint numConfigs;
     EGLint format;
     EGLSurface surface;
-    EGLContext context;
+    EGLContext context = EGL_NO_CONTEXT;
     EGLint width;
     EGLint height;
 
+#ifdef __ANDROID__
     if (NativeWindow == NULL)
     {
     	goto fail;
     }
+#else
+    /* no window: render into a pbuffer, for tests on desktop Mesa */
+    if (NativeWindow == NULL)
+    {
+        attribs[9] = EGL_PBUFFER_BIT;
+    }
+#endif
 
     h = malloc(sizeof(EGL));
     if (h == NULL)
@@ -116,32 +160,59 @@ EGL_HANDLE egl_open(void* NativeWindow)
         goto fail;
     }
 
-    if (!eglChooseConfig(display, attribs, &config, 1, &numConfigs)) {
-        LOGI("eglChooseConfig() returned error %d", eglGetError());
-        goto fail;
+    for (i = 0; i < sizeof(apis) / sizeof(apis[0]); i++)
+    {
+        attribs[7] = apis[i].render_bit;
+
+        if (!eglChooseConfig(display, attribs, &config, 1, &numConfigs) || numConfigs < 1) {
+            LOGI("eglChooseConfig() returned error %d", eglGetError());
+            continue;
+        }
+
+        if (eglBindAPI (apis[i].api) != EGL_TRUE)
+        {
+            LOGI("cannot bind EGL API");
+            continue;
+        }
+
+        context = eglCreateContext(display, config, EGL_NO_CONTEXT, apis[i].attr);
+        if (context != EGL_NO_CONTEXT)
+        {
+            LOGI("egl context: %s %d", apis[i].name, apis[i].attr[1]);
+            break;
+        }
+        LOGI("eglCreateContext() returned error %d", eglGetError());
     }
 
-    if (!eglGetConfigAttrib(display, config, EGL_NATIVE_VISUAL_ID, &format)) {
-        LOGI("eglGetConfigAttrib() returned error %d", eglGetError());
+    if (context == EGL_NO_CONTEXT) {
         goto fail;
     }
 
-    ANativeWindow_setBuffersGeometry(NativeWindow, 0, 0, format);
-
-    if (!(surface = eglCreateWindowSurface(display, config, NativeWindow, 0))) {
-        LOGI("eglCreateWindowSurface() returned error %d", eglGetError());
-        goto fail;
+    if (NativeWindow == NULL) {
+        const EGLint pbuffer_attribs[] = {
+            EGL_WIDTH, EGL_HEADLESS_WIDTH,
+            EGL_HEIGHT, EGL_HEADLESS_HEIGHT,
+            EGL_NONE
+        };
+        if (!(surface = eglCreatePbufferSurface(display, config, pbuffer_attribs))) {
+            LOGI("eglCreatePbufferSurface() returned error %d", eglGetError());
+            goto fail;
+        }
     }
-
-    if (eglBindAPI (api.api) != EGL_TRUE)
-    {
-        LOGI("cannot bind EGL API");
-        goto fail;
-    }
-
-    if (!(context = eglCreateContext(display, config, EGL_NO_CONTEXT, api.attr))) {
-        LOGI("eglCreateContext() returned error %d", eglGetError());
-        goto fail;
+    else {
+        if (!eglGetConfigAttrib(display, config, EGL_NATIVE_VISUAL_ID, &format)) {
+            LOGI("eglGetConfigAttrib() returned error %d", eglGetError());
+            goto fail;
+        }
+
+#ifdef __ANDROID__
+        ANativeWindow_setBuffersGeometry(NativeWindow, 0, 0, format);
+#endif
+
+        if (!(surface = eglCreateWindowSurface(display, config, (EGLNativeWindowType)NativeWindow, 0))) {
+            LOGI("eglCreateWindowSurface() returned error %d", eglGetError());
+            goto fail;
+        }
     }
 
     if (!eglMakeCurrent(display, surface, surface, context)) {
@@ -160,6 +231,16 @@ EGL_HANDLE egl_open(void* NativeWindow)
     h->surface = surface;
     h->context = context;
 
+    /* zero copy input */
+    const char *egl_extensions = eglQueryString(display, EGL_EXTENSIONS);
+    if (egl_extensions != NULL && strstr(egl_extensions, "EGL_KHR_image_base") != NULL)
+    {
+        h->CreateImageKHR  = (PFN_veglCreateImageKHR)eglGetProcAddress("eglCreateImageKHR");
+        h->DestroyImageKHR = (PFN_veglDestroyImageKHR)eglGetProcAddress("eglDestroyImageKHR");
+        h->supports_dma_buf = strstr(egl_extensions, "EGL_EXT_image_dma_buf_import") != NULL;
+    }
+    LOGI("egl image: %d, dma-buf import: %d", h->CreateImageKHR != NULL, h->supports_dma_buf);
+
 //    LOGI("egl_open success  width: %d, height: %d", width, height);
 
 //	egl_set_rect(h, 352, 288);
@@ -221,3 +302,72 @@ void egl_query_surface(EGL_HANDLE h, int * width, int *height)
     }
 }
 
+void *egl_image_import(EGL_HANDLE h, PVO_IN_IMAGE img, int *owned)
+{
+	static const EGLint plane_attribs[3][3] = {
+		{ EGL_DMA_BUF_PLANE0_FD_EXT, EGL_DMA_BUF_PLANE0_OFFSET_EXT, EGL_DMA_BUF_PLANE0_PITCH_EXT },
+		{ EGL_DMA_BUF_PLANE1_FD_EXT, EGL_DMA_BUF_PLANE1_OFFSET_EXT, EGL_DMA_BUF_PLANE1_PITCH_EXT },
+		{ EGL_DMA_BUF_PLANE2_FD_EXT, EGL_DMA_BUF_PLANE2_OFFSET_EXT, EGL_DMA_BUF_PLANE2_PITCH_EXT },
+	};
+	EGLint attribs[7 + 3 * 6];
+	int n = 0;
+	int i;
+	void *image;
+
+	*owned = 0;
+
+	if ((h == NULL) || (img == NULL))
+	{
+		return NULL;
+	}
+
+	if (img->p_image != NULL)
+	{
+		return img->p_image;
+	}
+
+	if (!h->supports_dma_buf || (h->CreateImageKHR == NULL) ||
+		(img->i_plane_count < 1) || (img->i_plane_count > 3))
+	{
+		return NULL;
+	}
+
+	attribs[n++] = EGL_WIDTH;
+	attribs[n++] = img->i_width;
+	attribs[n++] = EGL_HEIGHT;
+	attribs[n++] = img->i_height;
+	attribs[n++] = EGL_LINUX_DRM_FOURCC_EXT;
+	attribs[n++] = img->i_fourcc;
+	for (i = 0; i < img->i_plane_count; i++)
+	{
+		attribs[n++] = plane_attribs[i][0];
+		attribs[n++] = img->p[i].i_fd;
+		attribs[n++] = plane_attribs[i][1];
+		attribs[n++] = img->p[i].i_offset;
+		attribs[n++] = plane_attribs[i][2];
+		attribs[n++] = img->p[i].i_pitch;
+	}
+	attribs[n++] = EGL_NONE;
+
+	image = h->CreateImageKHR(h->display, EGL_NO_CONTEXT, EGL_LINUX_DMA_BUF_EXT,
+							  (EGLClientBuffer)NULL, attribs);
+	if (image == NULL)
+	{
+		LOGI("eglCreateImageKHR(dma-buf) returned error %d", eglGetError());
+		return NULL;
+	}
+
+	*owned = 1;
+
+	return image;
+}
+
+void egl_image_release(EGL_HANDLE h, void *image)
+{
+	if ((h == NULL) || (image == NULL) || (h->DestroyImageKHR == NULL))
+	{
+		return;
+	}
+
+	h->DestroyImageKHR(h->display, image);
+}
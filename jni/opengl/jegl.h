@@ -1,6 +1,7 @@
 #ifndef _EGL_H
 #define _EGL_H
 
+#include "../JVideoOut.h"
 
 typedef struct _EGL * EGL_HANDLE;
 
@@ -9,5 +10,9 @@ int egl_do(EGL_HANDLE h);
 void egl_close(EGL_HANDLE h);
 void egl_query_surface(EGL_HANDLE h, int * width, int * height);
 
+/* EGLImage of img, *owned: the image was imported here and must be released */
+void *egl_image_import(EGL_HANDLE h, PVO_IN_IMAGE img, int *owned);
+void egl_image_release(EGL_HANDLE h, void *image);
+
 
 #endif // _EGL_H
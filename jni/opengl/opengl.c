@@ -1,14 +1,104 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <malloc.h>
 #include <string.h>
+#include <time.h>
+#include <unistd.h>
 #include <GLES2/gl2.h>
+#include <GLES2/gl2ext.h>
+#include <EGL/egl.h>
 #include <math.h>
+#include <pthread.h>
 #include "vlc_fourcc.h"
 
+#include "copy.h"
 #include "opengl.h"
 #include "../log.h"
 
 #define PICTURE_PLANE_MAX 3
+#define VLCGL_PBO_MAX 4
+#define VLCGL_TIMER_MAX 4
+
+/* luma sampling, picked from the minification of the picture */
+#define VLCGL_SCALER_BILINEAR 0
+#define VLCGL_SCALER_MIPMAP   1   /* trilinear, above 2x */
+#define VLCGL_SCALER_BICUBIC  2   /* b-spline in four bilinear taps, 1x to 2x */
+
+/* GLES3 tokens, the GLES2 headers of old ndk do not define them */
+#ifndef GL_PIXEL_UNPACK_BUFFER
+#   define GL_PIXEL_UNPACK_BUFFER           0x88EC
+#endif
+#ifndef GL_UNPACK_ROW_LENGTH
+#   define GL_UNPACK_ROW_LENGTH             0x0CF2
+#endif
+#ifndef GL_MAP_WRITE_BIT
+#   define GL_MAP_WRITE_BIT                 0x0002
+#endif
+#ifndef GL_MAP_INVALIDATE_RANGE_BIT
+#   define GL_MAP_INVALIDATE_RANGE_BIT      0x0004
+#endif
+#ifndef GL_MAP_UNSYNCHRONIZED_BIT
+#   define GL_MAP_UNSYNCHRONIZED_BIT        0x0020
+#endif
+#ifndef GL_SYNC_GPU_COMMANDS_COMPLETE
+#   define GL_SYNC_GPU_COMMANDS_COMPLETE    0x9117
+#   define GL_SYNC_FLUSH_COMMANDS_BIT       0x00000001
+#endif
+
+#ifndef GL_RED_EXT
+#   define GL_RED_EXT                       0x1903
+#endif
+#ifndef GL_R16_EXT
+#   define GL_R16_EXT                       0x822A
+#endif
+#ifndef GL_TEXTURE_EXTERNAL_OES
+#   define GL_TEXTURE_EXTERNAL_OES          0x8D65
+#endif
+#ifndef GL_PROGRAM_BINARY_LENGTH
+#   define GL_PROGRAM_BINARY_LENGTH         0x8741
+#endif
+#ifndef GL_NUM_PROGRAM_BINARY_FORMATS
+#   define GL_NUM_PROGRAM_BINARY_FORMATS    0x87FE
+#endif
+#ifndef GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+#   define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#endif
+#ifndef GL_TIME_ELAPSED_EXT
+#   define GL_TIME_ELAPSED_EXT              0x88BF
+#endif
+#ifndef GL_GPU_DISJOINT_EXT
+#   define GL_GPU_DISJOINT_EXT              0x8FBB
+#endif
+#ifndef GL_QUERY_RESULT_EXT
+#   define GL_QUERY_RESULT_EXT              0x8866
+#endif
+#ifndef GL_QUERY_RESULT_AVAILABLE_EXT
+#   define GL_QUERY_RESULT_AVAILABLE_EXT    0x8867
+#endif
+#ifndef GL_COLOR_EXT
+#   define GL_COLOR_EXT                     0x1800
+#endif
+
+/* GLES3 entry points, resolved with eglGetProcAddress */
+typedef void *     (GL_APIENTRYP PFN_vglMapBufferRange)(GLenum, GLintptr, GLsizeiptr, GLbitfield);
+typedef GLboolean  (GL_APIENTRYP PFN_vglUnmapBuffer)(GLenum);
+typedef void *     (GL_APIENTRYP PFN_vglFenceSync)(GLenum, GLbitfield);
+typedef GLenum     (GL_APIENTRYP PFN_vglClientWaitSync)(void *, GLbitfield, uint64_t);
+typedef void       (GL_APIENTRYP PFN_vglDeleteSync)(void *);
+typedef void       (GL_APIENTRYP PFN_vglEGLImageTargetTexture2DOES)(GLenum, void *);
+typedef void       (GL_APIENTRYP PFN_vglGetProgramBinary)(GLuint, GLsizei, GLsizei *, GLenum *, void *);
+typedef void       (GL_APIENTRYP PFN_vglProgramBinary)(GLuint, GLenum, const void *, GLint);
+typedef void       (GL_APIENTRYP PFN_vglProgramParameteri)(GLuint, GLenum, GLint);
+typedef void       (GL_APIENTRYP PFN_vglGenVertexArrays)(GLsizei, GLuint *);
+typedef void       (GL_APIENTRYP PFN_vglDeleteVertexArrays)(GLsizei, const GLuint *);
+typedef void       (GL_APIENTRYP PFN_vglBindVertexArray)(GLuint);
+typedef void       (GL_APIENTRYP PFN_vglGenQueries)(GLsizei, GLuint *);
+typedef void       (GL_APIENTRYP PFN_vglDeleteQueries)(GLsizei, const GLuint *);
+typedef void       (GL_APIENTRYP PFN_vglBeginQuery)(GLenum, GLuint);
+typedef void       (GL_APIENTRYP PFN_vglEndQuery)(GLenum);
+typedef void       (GL_APIENTRYP PFN_vglGetQueryObjectuiv)(GLuint, GLenum, GLuint *);
+typedef void       (GL_APIENTRYP PFN_vglGetQueryObjectui64v)(GLuint, GLenum, uint64_t *);
+typedef void       (GL_APIENTRYP PFN_vglInvalidateFramebuffer)(GLenum, GLsizei, const GLenum *);
 
 typedef struct video_format_t
 {
@@ -22,34 +112,262 @@ typedef struct video_format_t
 	int i_visible_width;                 /**< width of visible area */
     int i_visible_height;               /**< height of visible area */
 
+    int i_matrix;                       /**< JVO_MATRIX_*, never auto */
+    int i_range;                        /**< JVO_RANGE_*, never auto */
 }video_format_t;
 
 #   define GLSL_VERSION "100"
-#   define VLCGL_TEXTURE_COUNT 1
+#   define VLCGL_TEXTURE_MAX 3
+#   define VLCGL_TEXTURE_DEFAULT 2
 #   define VLCGL_PICTURE_MAX 1
+#   define VLCGL_POOL_MAX 4
+#   define VLCGL_CROP_GUARD 16
+#   define VLCGL_DECIMATE_HYSTERESIS 0.875
+#   define VLCGL_DECIMATE_DEFAULT 1
+#   define VLCGL_POOL_BYTES (24 << 20)
 #   define PRECISION "precision highp float;"
 #   define SUPPORTS_SHADERS
 #   define glClientActiveTexture(x)
 
 
+/* Texture sets parked by a resolution or layout switch, texture_count == 0: free */
+typedef struct
+{
+    vlc_fourcc_t chroma;
+    unsigned     width;
+    unsigned     height;
+    unsigned     plane_count;
+    int          texture_count;
+    GLuint       texture[VLCGL_TEXTURE_MAX][PICTURE_PLANE_MAX];
+    int          mipmap_storage[VLCGL_TEXTURE_MAX];
+    int          bytes;
+    int64_t      last_use;
+} vlcgl_texture_pool_t;
+
+/* A linked yuv program and its locations, resolved once after the link */
+typedef struct vlcgl_program_t
+{
+    struct vlcgl_program_t *next;
+    vlc_fourcc_t chroma;
+    int          sample_format;   /* texture format of 16 bit planes, 0 otherwise */
+    int          bicubic;
+    GLuint       program;
+    GLint        shader[2];
+    GLint        uniform_coefficient;
+    GLint        uniform_texture[PICTURE_PLANE_MAX];
+    GLint        uniform_tex_width;
+    GLint        uniform_tex_size;
+    GLint        uniform_transform;
+    GLint        attrib_position;
+    GLint        attrib_tex_coord[PICTURE_PLANE_MAX];
+} vlcgl_program_t;
+
+/* Bindings and pixel store of one GL context as last set by this module,
+ * so a call that would not change them is skipped. VLCGL_UNKNOWN: not
+ * known, e.g. after an object was deleted. Attributes are only tracked in
+ * the default vertex array. */
+#define VLCGL_UNKNOWN    0xFFFFFFFFu
+#define VLCGL_ATTRIB_MAX 8
+
+typedef struct vlcgl_state_t
+{
+    GLuint       program;
+    GLuint       active_texture;
+    GLuint       texture[PICTURE_PLANE_MAX];          /* GL_TEXTURE_2D per unit */
+    GLuint       texture_external[PICTURE_PLANE_MAX]; /* GL_TEXTURE_EXTERNAL_OES */
+    GLuint       array_buffer;
+    GLuint       unpack_buffer;
+    GLuint       vertex_array;
+    GLuint       attrib_enabled;                      /* bit per location, known_attribs */
+    GLuint       known_attribs;
+    GLuint       attrib_buffer[VLCGL_ATTRIB_MAX];
+    intptr_t     attrib_offset[VLCGL_ATTRIB_MAX];
+    GLint        unpack_alignment;
+    GLint        unpack_row_length;
+    GLint        viewport[4];
+    GLint        scissor_test;
+    int          calls;                               /* gl calls, debug builds */
+} vlcgl_state_t;
+
+/* Every gl call of the frame path goes through VLCGL_CALL, debug builds
+ * count them for the stats */
+#ifndef NDEBUG
+#   define VLCGL_CALL(state, call) ((state)->calls++, (call))
+#else
+#   define VLCGL_CALL(state, call) (call)
+#endif
+
+/* Programs and state of the GL context of an instance; each handle opens
+ * its own context, the binaries on disk are what instances share */
+typedef struct vlcgl_program_cache_t
+{
+    vlcgl_program_t *programs;
+    vlcgl_state_t    state;
+} vlcgl_program_cache_t;
+
+/* Forget the bindings, the next call of each kind goes to GL. Deleting
+ * buffers or textures does not change the vertex array binding, it is
+ * kept. */
+static void StateReset(vlcgl_state_t *st)
+{
+    GLuint vertex_array = st->vertex_array;
+    int calls = st->calls;
+
+    memset(st, 0xFF, sizeof(*st));
+    st->known_attribs = 0;
+    st->vertex_array = vertex_array;
+    st->calls = calls;
+}
+
+/* Deleting the bound vertex array falls back to the default one */
+static void StateDeleteVertexArray(vlcgl_state_t *st, GLuint array)
+{
+    if (st->vertex_array == array)
+        st->vertex_array = 0;
+}
+
+static void StateUseProgram(vlcgl_state_t *st, GLuint program)
+{
+    if (st->program == program)
+        return;
+    VLCGL_CALL(st, glUseProgram(program));
+    st->program = program;
+}
+
+static void StateActiveTexture(vlcgl_state_t *st, unsigned unit)
+{
+    if (st->active_texture == unit)
+        return;
+    VLCGL_CALL(st, glActiveTexture(GL_TEXTURE0 + unit));
+    st->active_texture = unit;
+}
+
+static void StateBindTexture(vlcgl_state_t *st, unsigned unit, GLenum target, GLuint texture)
+{
+    GLuint *bound = target == GL_TEXTURE_EXTERNAL_OES ? st->texture_external : st->texture;
+
+    if (unit < PICTURE_PLANE_MAX && bound[unit] == texture)
+        return;
+    StateActiveTexture(st, unit);
+    VLCGL_CALL(st, glBindTexture(target, texture));
+    if (unit < PICTURE_PLANE_MAX)
+        bound[unit] = texture;
+}
+
+/* Bind for an upload or a parameter change, which go through the active
+ * unit even when the texture was already bound there */
+static void StateEditTexture(vlcgl_state_t *st, unsigned unit, GLenum target, GLuint texture)
+{
+    StateActiveTexture(st, unit);
+    StateBindTexture(st, unit, target, texture);
+}
+
+static void StateBindBuffer(vlcgl_state_t *st, GLenum target, GLuint buffer)
+{
+    GLuint *bound = target == GL_PIXEL_UNPACK_BUFFER ? &st->unpack_buffer : &st->array_buffer;
+
+    if (*bound == buffer)
+        return;
+    VLCGL_CALL(st, glBindBuffer(target, buffer));
+    *bound = buffer;
+}
+
+static void StatePixelStore(vlcgl_state_t *st, GLenum pname, GLint value)
+{
+    GLint *current = pname == GL_UNPACK_ROW_LENGTH ? &st->unpack_row_length
+                                                   : &st->unpack_alignment;
+
+    if (*current == value)
+        return;
+    VLCGL_CALL(st, glPixelStorei(pname, value));
+    *current = value;
+}
+
+/* Enable the attribute at index and point it at offset in buffer */
+static void StateAttribPointer(vlcgl_state_t *st, GLint index, GLuint buffer, intptr_t offset)
+{
+    /* -1: the compiler dropped the attribute */
+    if (index < 0)
+        return;
+
+    int tracked = st->vertex_array == 0 && index < VLCGL_ATTRIB_MAX;
+    GLuint bit = tracked ? 1u << index : 0;
+
+    if (!tracked || !(st->known_attribs & bit) || !(st->attrib_enabled & bit)) {
+        VLCGL_CALL(st, glEnableVertexAttribArray(index));
+    }
+    if (!tracked || !(st->known_attribs & bit) ||
+        st->attrib_buffer[index] != buffer || st->attrib_offset[index] != offset) {
+        StateBindBuffer(st, GL_ARRAY_BUFFER, buffer);
+        VLCGL_CALL(st, glVertexAttribPointer(index, 2, GL_FLOAT, 0, 0, (const void *)offset));
+    }
+    if (tracked) {
+        st->known_attribs |= bit;
+        st->attrib_enabled |= bit;
+        st->attrib_buffer[index] = buffer;
+        st->attrib_offset[index] = offset;
+    }
+}
+
+static void StateViewport(vlcgl_state_t *st, const int *view)
+{
+    if (!memcmp(st->viewport, view, sizeof(st->viewport)))
+        return;
+    VLCGL_CALL(st, glViewport(view[0], view[1], view[2], view[3]));
+    memcpy(st->viewport, view, sizeof(st->viewport));
+}
+
+static void StateScissorTest(vlcgl_state_t *st, int enable)
+{
+    if (st->scissor_test == enable)
+        return;
+    if (enable)
+        VLCGL_CALL(st, glEnable(GL_SCISSOR_TEST));
+    else
+        VLCGL_CALL(st, glDisable(GL_SCISSOR_TEST));
+    st->scissor_test = enable;
+}
+
 struct vout_display_opengl_t {
     video_format_t fmt;
     vlc_chroma_description_t *chroma;
 
     int        tex_target;
-    int        tex_format;
-    int        tex_internal;
+    int        tex_format[PICTURE_PLANE_MAX];
+    int        tex_internal[PICTURE_PLANE_MAX];
     int        tex_type;
+    int        tex_pixel_size[PICTURE_PLANE_MAX]; /* bytes per texel */
 
     int        tex_width[PICTURE_PLANE_MAX];
     int        tex_height[PICTURE_PLANE_MAX];
 
-    GLuint     texture[VLCGL_TEXTURE_COUNT][PICTURE_PLANE_MAX];
-
-    GLuint     program;
-    GLint      shader[3];
-    int        local_count;
+    /* texture sets, uploads rotate through them so that a set is not
+     * overwritten while the draw of the previous frame still reads it */
+    GLuint     texture[VLCGL_TEXTURE_MAX][PICTURE_PLANE_MAX];
+    int        texture_count;
+    int        texture_index;
+    int        texture_bytes;
+
+    /* sets of the previous resolutions, reused when the stream switches back */
+    vlcgl_texture_pool_t pool[VLCGL_POOL_MAX];
+    int        pool_bytes;
+
+    /* program of the current layout, owned by program_cache; the constant
+     * uniforms are sent again when uniforms_dirty is set */
+    vlcgl_program_cache_t *program_cache;
+    vlcgl_state_t *state;
+    vlcgl_program_t *prog;
     GLfloat    local_value[16];
+    int        uniforms_dirty;
+
+    /* the quad never changes, the texture coordinates are rewritten only
+     * when the view moves; vertex_array records the attribute setup */
+    GLuint     vertex_buffer;
+    GLuint     tex_coord_buffer;
+    GLfloat    tex_coord[PICTURE_PLANE_MAX][8];
+    int        tex_coord_valid;
+    GLuint     vertex_array;
+    int        vertex_array_dirty;
 
     int use_multitexture;
 
@@ -58,15 +376,110 @@ struct vout_display_opengl_t {
     unsigned char *texture_temp_buf;
     int      texture_temp_buf_size;
 
-	float scale_w[PICTURE_PLANE_MAX];
-	float scale_h[PICTURE_PLANE_MAX];
-
+	/* part of each plane texture the picture fills, less than 1 when the
+	 * texture is padded to a power of two or to the pitch */
 	float left[PICTURE_PLANE_MAX];
 	float top[PICTURE_PLANE_MAX];
 	float right[PICTURE_PLANE_MAX];
 	float bottom[PICTURE_PLANE_MAX];
 
-	int frame_count;
+    /* zoom, pan, rotation and mirror of the quad in normalized device
+     * coordinates, column major; the texture coordinates above only change
+     * with the textures. transform is the orientation of the camera, then
+     * the display_scale of the fill and 1:1 modes, then user_transform.
+     * visible is the part of the picture on screen, x0 y0 x1 y1 in [0,1] */
+    GLfloat    transform[9];
+    GLfloat    user_transform[9];
+    GLfloat    orientation[9];
+    float      display_scale[2];
+    int        transform_dirty;
+    float      visible[4];
+
+    /* viewport x y w h and window size in pixels; the quad leaves only the
+     * background rects uncovered. background_count < 0: clear the whole
+     * window, 0: the quad covers it and nothing is cleared */
+    int        view[4];
+    int        surface[2];
+    int        background_dirty;
+    int        background_count;
+    int        background[4][4];
+
+    /* luma filter, VLCGL_SCALER_*; mipmap levels of a set are generated
+     * again after each upload, mipmap_filter < 0: min filter unknown,
+     * mipmap_storage: the levels of the set are allocated and counted in
+     * texture_bytes */
+    int        scaler;
+    int        supports_mipmap;
+    int        mipmap_valid[VLCGL_TEXTURE_MAX];
+    int        mipmap_storage[VLCGL_TEXTURE_MAX];
+    int        mipmap_filter[VLCGL_TEXTURE_MAX];
+
+    int gles3;
+    int supports_pbo;
+    int supports_unpack_subimage;
+    int supports_norm16;
+    int supports_program_binary;
+
+    /* pixel buffer object upload ring, pbo_count == 0: direct upload */
+    int        pbo_count;
+    int        pbo_index;
+    GLuint     pbo[VLCGL_PBO_MAX][PICTURE_PLANE_MAX];
+    int        pbo_size[VLCGL_PBO_MAX][PICTURE_PLANE_MAX];
+    void *     pbo_fence[VLCGL_PBO_MAX];
+
+    /* dirty band uploads, dirty_band_height == 0: every frame is sent in full */
+    int        dirty_band_height;
+    int        dirty_band_count;
+    int64_t    dirty_frame;
+    int64_t *  dirty_stamp;                        /* last frame a band changed */
+    int64_t    dirty_set_stamp[VLCGL_TEXTURE_MAX]; /* frame a set was filled with */
+    uint8_t *  dirty_shadow[PICTURE_PLANE_MAX];    /* copy of the last frame */
+
+    /* zoomed in, only the visible rect plus a guard band is uploaded;
+     * a set is sent in full once per crop_generation. crop_upload 0: the
+     * whole picture always, the redraws may zoom out of any crop */
+    VO_RECT    crop;
+    int        crop_generation;
+    int        crop_set_generation[VLCGL_TEXTURE_MAX];
+    int        crop_upload;
+
+    int        upload_bytes;
+
+    /* gpu time of the upload and draw, read back VLCGL_TIMER_MAX - 1 frames
+     * later so the cpu never waits for a result */
+    int        supports_timer_query;
+    GLuint     timer_query[VLCGL_TIMER_MAX];
+    int        timer_pending[VLCGL_TIMER_MAX];
+    int        timer_index;
+    int        timer_active;
+
+    /* external image input, sampled in place without any upload */
+    GLuint     image_program;
+    GLint      image_shader[2];
+    GLint      image_attrib_position;
+    GLint      image_attrib_tex_coord;
+    GLint      image_uniform_transform;
+    GLuint     image_texture;
+
+    PFN_vglMapBufferRange   MapBufferRange;
+    PFN_vglUnmapBuffer      UnmapBuffer;
+    PFN_vglFenceSync        FenceSync;
+    PFN_vglClientWaitSync   ClientWaitSync;
+    PFN_vglDeleteSync       DeleteSync;
+    PFN_vglEGLImageTargetTexture2DOES EGLImageTargetTexture2DOES;
+    PFN_vglGetProgramBinary   GetProgramBinary;
+    PFN_vglProgramBinary      ProgramBinary;
+    PFN_vglProgramParameteri  ProgramParameteri;
+    PFN_vglGenVertexArrays    GenVertexArrays;
+    PFN_vglDeleteVertexArrays DeleteVertexArrays;
+    PFN_vglBindVertexArray    BindVertexArray;
+    PFN_vglGenQueries       GenQueries;
+    PFN_vglDeleteQueries    DeleteQueries;
+    PFN_vglBeginQuery       BeginQuery;
+    PFN_vglEndQuery         EndQuery;
+    PFN_vglGetQueryObjectuiv   GetQueryObjectuiv;
+    PFN_vglGetQueryObjectui64v GetQueryObjectui64v;
+    PFN_vglInvalidateFramebuffer InvalidateFramebuffer;
 };
 
 typedef struct vout_display_opengl_t vout_display_opengl_t;
@@ -84,6 +497,17 @@ static inline int HasExtension(const char *apis, const char *api)
     return 0;
 }
 
+static inline int IsPlanar16(vlc_fourcc_t chroma)
+{
+    return chroma == VLC_CODEC_I420_10L || chroma == VLC_CODEC_I420_9L;
+}
+
+static inline int IsPacked422(vlc_fourcc_t chroma)
+{
+    return chroma == VLC_CODEC_YUYV || chroma == VLC_CODEC_YVYU ||
+           chroma == VLC_CODEC_UYVY || chroma == VLC_CODEC_VYUY;
+}
+
 static inline int GetAlignedSize(unsigned size)
 {
     /* Return the smallest larger or equal power of 2 */
@@ -93,54 +517,115 @@ static inline int GetAlignedSize(unsigned size)
 }
 
 
+/* Basic vertex shader */
+static const char *vertexShader =
+    "#version " GLSL_VERSION "\n"
+    PRECISION
+    "varying vec4 TexCoord0,TexCoord1, TexCoord2;"
+    "attribute vec4 MultiTexCoord0,MultiTexCoord1,MultiTexCoord2;"
+    "attribute vec4 VertexPosition;"
+    "uniform mat3 Transform;"
+    "void main() {"
+    " TexCoord0 = MultiTexCoord0;"
+    " TexCoord1 = MultiTexCoord1;"
+    " TexCoord2 = MultiTexCoord2;"
+    " gl_Position = vec4((Transform * vec3(VertexPosition.xy, 1.0)).xy, 0.0, 1.0);"
+    "}";
+
 static void BuildVertexShader(vout_display_opengl_t *vgl,
                               GLint *shader)
 {
-    /* Basic vertex shader */
-    const char *vertexShader =
+    *shader = VLCGL_CALL(vgl->state, glCreateShader(GL_VERTEX_SHADER));
+    VLCGL_CALL(vgl->state, glShaderSource(*shader, 1, &vertexShader, NULL));
+    VLCGL_CALL(vgl->state, glCompileShader(*shader));
+}
+
+/* Fragment shader source of the layout of fmt->i_chroma, the color matrix
+ * is the Coefficient uniform so one program serves every matrix and range.
+ * bicubic: b-spline luma, for pictures shrunk by 1x to 2x */
+static char *GetYUVFragmentShader(vout_display_opengl_t *vgl,
+                                  const video_format_t *fmt, int bicubic)
+{
+    /* Basic linear YUV -> RGB conversion using bilinear interpolation */
+    const char *template_glsl_yuv_semiplanar =
         "#version " GLSL_VERSION "\n"
         PRECISION
-        "varying vec4 TexCoord0,TexCoord1, TexCoord2;"
-        "attribute vec4 MultiTexCoord0,MultiTexCoord1,MultiTexCoord2;"
-        "attribute vec4 VertexPosition;"
-        "void main() {"
-        " TexCoord0 = MultiTexCoord0;"
-        " TexCoord1 = MultiTexCoord1;"
-        " TexCoord2 = MultiTexCoord2;"
-        " gl_Position = VertexPosition;"
+        "uniform sampler2D Texture0;"
+        "uniform sampler2D Texture1;"
+        "uniform vec4      Coefficient[4];"
+        "varying vec4      TexCoord0,TexCoord1,TexCoord2;"
+        "%s"
+
+        "void main(void) {"
+        " vec4 x,y,z,uv,result;"
+        " x  = Luma(TexCoord0.st);"
+        " uv = texture2D(Texture1, TexCoord1.st);"
+        " y  = vec4(uv.%c);"
+        " z  = vec4(uv.%c);"
+
+        " result = x * Coefficient[0] + Coefficient[3];"
+        " result = (y * Coefficient[1]) + result;"
+        " result = (z * Coefficient[2]) + result;"
+        " gl_FragColor = result;"
         "}";
+    /* Packed 4:2:2, one rgba texel holds two pixels. Chroma is a plain
+     * bilinear fetch. The two luma pixels around the sample come from
+     * fetches at their texel centers, filtered vertically only, and are
+     * mixed here */
+    const char *template_glsl_yuv_packed =
+        "#version " GLSL_VERSION "\n"
+        PRECISION
+        "uniform sampler2D Texture0;"
+        "uniform vec4      Coefficient[4];"
+        "uniform float     TexWidth;"
+        "varying vec4      TexCoord0,TexCoord1,TexCoord2;"
 
-    *shader = glCreateShader(GL_VERTEX_SHADER);
-    glShaderSource(*shader, 1, &vertexShader, NULL);
-    glCompileShader(*shader);
-}
+        "float Pixel(float i) {"
+        " i = clamp(i, 0.0, TexWidth * 2.0 - 1.0);"
+        " vec4 p = texture2D(Texture0, vec2((floor(i * 0.5) + 0.5) / TexWidth, TexCoord0.t));"
+        " return mix(p.%c, p.%c, mod(i, 2.0));"
+        "}"
 
-static void BuildYUVFragmentShader(vout_display_opengl_t *vgl,
-                                   GLint *shader,
-                                   int *local_count,
-                                   GLfloat *local_value,
-                                   const video_format_t *fmt,
-                                   float yuv_range_correction)
+        "void main(void) {"
+        " vec4 x,y,z,p,result;"
+        " float i,f;"
+        " i   = TexCoord0.s * TexWidth * 2.0 - 0.5;"
+        " f   = fract(i);"
+        " x   = vec4(mix(Pixel(i - f), Pixel(i - f + 1.0), f));"
+        " p   = texture2D(Texture0, TexCoord0.st);"
+        " y   = vec4(p.%c);"
+        " z   = vec4(p.%c);"
 
-{
-    /* [R/G/B][Y U V O] from TV range to full range
-     * XXX we could also do hue/brightness/constrast/gamma
-     * by simply changing the coefficients
-     */
-    const float matrix_bt601_tv2full[12] = {
-        1.164383561643836,  0.0000,             1.596026785714286, -0.874202217873451 ,
-        1.164383561643836, -0.391762290094914, -0.812967647237771,  0.531667823499146 ,
-        1.164383561643836,  2.017232142857142,  0.0000,            -1.085630789302022 ,
-    };
-    const float matrix_bt709_tv2full[12] = {
-        1.164383561643836,  0.0000,             1.792741071428571, -0.972945075016308 ,
-        1.164383561643836, -0.21324861427373,  -0.532909328559444,  0.301482665475862 ,
-        1.164383561643836,  2.112401785714286,  0.0000,            -1.133402217873451 ,
-    };
-    const float (*matrix) = fmt->i_height > 576 ? matrix_bt709_tv2full
-                                                : matrix_bt601_tv2full;
+        " result = x * Coefficient[0] + Coefficient[3];"
+        " result = (y * Coefficient[1]) + result;"
+        " result = (z * Coefficient[2]) + result;"
+        " gl_FragColor = result;"
+        "}";
+    /* 9/10 bit planes, in r16 textures or split in low (luminance)
+     * and high (alpha) bytes recombined here */
+    const char *template_glsl_yuv16 =
+        "#version " GLSL_VERSION "\n"
+        PRECISION
+        "uniform sampler2D Texture0;"
+        "uniform sampler2D Texture1;"
+        "uniform sampler2D Texture2;"
+        "uniform vec4      Coefficient[4];"
+        "varying vec4      TexCoord0,TexCoord1,TexCoord2;"
 
-    /* Basic linear YUV -> RGB conversion using bilinear interpolation */
+        "float Sample(vec4 t) { return %s; }"
+        "%s"
+
+        "void main(void) {"
+        " vec4 x,y,z,result;"
+        " x  = vec4(Sample(Luma(TexCoord0.st)));"
+        " %c = vec4(Sample(texture2D(Texture1, TexCoord1.st)));"
+        " %c = vec4(Sample(texture2D(Texture2, TexCoord2.st)));"
+
+        " result = x * Coefficient[0] + Coefficient[3];"
+        " result = (y * Coefficient[1]) + result;"
+        " result = (z * Coefficient[2]) + result;"
+        " gl_FragColor = result;"
+        "}";
     const char *template_glsl_yuv =
         "#version " GLSL_VERSION "\n"
         PRECISION
@@ -149,10 +634,11 @@ static void BuildYUVFragmentShader(vout_display_opengl_t *vgl,
         "uniform sampler2D Texture2;"
         "uniform vec4      Coefficient[4];"
         "varying vec4      TexCoord0,TexCoord1,TexCoord2;"
+        "%s"
 
         "void main(void) {"
         " vec4 x,y,z,result;"
-        " x  = texture2D(Texture0, TexCoord0.st);"
+        " x  = Luma(TexCoord0.st);"
         " %c = texture2D(Texture1, TexCoord1.st);"
         " %c = texture2D(Texture2, TexCoord2.st);"
 
@@ -161,255 +647,799 @@ static void BuildYUVFragmentShader(vout_display_opengl_t *vgl,
         " result = (z * Coefficient[2]) + result;"
         " gl_FragColor = result;"
         "}";
-  //  int swap_uv = fmt->i_chroma == VLC_CODEC_YV12;
-
-    int swap_uv = 1;
+    /* Luma fetch, the cubic b-spline weights of the 4x4 texels around the
+     * sample are folded into four bilinear fetches. Linear in the texels,
+     * so the byte split of 16 bit planes is recombined after it as well */
+    const char *luma_bilinear =
+        "vec4 Luma(vec2 c) { return texture2D(Texture0, c); }";
+    const char *luma_bicubic =
+        "uniform vec2 TexSize;"
+        "vec4 Luma(vec2 c) {"
+        " vec2 t  = c * TexSize - 0.5;"
+        " vec2 f  = fract(t);"
+        " vec2 f2 = f * f;"
+        " vec2 f3 = f2 * f;"
+        " vec2 w0 = (1.0 - 3.0 * f + 3.0 * f2 - f3) / 6.0;"
+        " vec2 w1 = (4.0 - 6.0 * f2 + 3.0 * f3) / 6.0;"
+        " vec2 w3 = f3 / 6.0;"
+        " vec2 g0 = w0 + w1;"
+        " vec2 g1 = 1.0 - g0;"
+        " vec2 p0 = (t - f - 0.5 + w1 / g0) / TexSize;"
+        " vec2 p1 = (t - f + 1.5 + w3 / g1) / TexSize;"
+        " return g0.y * (g0.x * texture2D(Texture0, p0) + g1.x * texture2D(Texture0, vec2(p1.x, p0.y))) +"
+        "        g1.y * (g0.x * texture2D(Texture0, vec2(p0.x, p1.y)) + g1.x * texture2D(Texture0, p1));"
+        "}";
+    const char *luma = bicubic ? luma_bicubic : luma_bilinear;
+
+    /* NV12/NV21 interleave u and v in one luminance/alpha texture */
+    int semiplanar = fmt->i_chroma == VLC_CODEC_NV12 || fmt->i_chroma == VLC_CODEC_NV21;
+    int swap_uv = fmt->i_chroma == VLC_CODEC_YV12 || fmt->i_chroma == VLC_CODEC_NV21;
+
+    /* component of y0, y1, u and v in a texel */
+    const char *packed = NULL;
+    switch (fmt->i_chroma) {
+    case VLC_CODEC_YUYV: packed = "rbga"; break;
+    case VLC_CODEC_YVYU: packed = "rbag"; break;
+    case VLC_CODEC_UYVY: packed = "garb"; break;
+    case VLC_CODEC_VYUY: packed = "gabr"; break;
+    }
 
     char *code;
-    if (asprintf(&code, template_glsl_yuv,
-                 swap_uv ? 'z' : 'y',
-                 swap_uv ? 'y' : 'z') < 0)
-        code = NULL;
+    if (IsPlanar16(fmt->i_chroma)) {
+        if (asprintf(&code, template_glsl_yuv16,
+                     vgl->tex_format[0] == GL_RED_EXT ? "t.r" : "t.r + t.a * 256.0",
+                     luma,
+                     swap_uv ? 'z' : 'y',
+                     swap_uv ? 'y' : 'z') < 0)
+            code = NULL;
+    } else if (packed) {
+        if (asprintf(&code, template_glsl_yuv_packed,
+                     packed[0], packed[1], packed[2], packed[3]) < 0)
+            code = NULL;
+    } else if (semiplanar) {
+        if (asprintf(&code, template_glsl_yuv_semiplanar, luma,
+                     swap_uv ? 'a' : 'r',
+                     swap_uv ? 'r' : 'a') < 0)
+            code = NULL;
+    } else {
+        if (asprintf(&code, template_glsl_yuv, luma,
+                     swap_uv ? 'z' : 'y',
+                     swap_uv ? 'y' : 'z') < 0)
+            code = NULL;
+    }
+
+    return code;
+}
+
+/* [R/G/B][Y U V O] to full range rgb, per JVO_MATRIX_* from the limited
+ * and from the full range
+ * XXX we could also do hue/brightness/constrast/gamma
+ * by simply changing the coefficients
+ */
+static const float yuv_matrix[3][2][12] = {
+    { /* BT.601 */
+        {
+            1.164383561643836,  0.0000,             1.596026785714286, -0.874202217873451 ,
+            1.164383561643836, -0.391762290094914, -0.812967647237771,  0.531667823499146 ,
+            1.164383561643836,  2.017232142857142,  0.0000,            -1.085630789302022 ,
+        }, {
+            1.0000,             0.0000,             1.402000000000000, -0.703749019607843 ,
+            1.0000,            -0.344136286201022, -0.714136286201022,  0.531211330460634 ,
+            1.0000,             1.772000000000000,  0.0000,            -0.889474509803922 ,
+        },
+    },
+    { /* BT.709 */
+        {
+            1.164383561643836,  0.0000,             1.792741071428571, -0.972945075016308 ,
+            1.164383561643836, -0.21324861427373,  -0.532909328559444,  0.301482665475862 ,
+            1.164383561643836,  2.112401785714286,  0.0000,            -1.133402217873451 ,
+        }, {
+            1.0000,             0.0000,             1.574800000000000, -0.790487843137255 ,
+            1.0000,            -0.187324272930649, -0.468124272930649,  0.329009466157828 ,
+            1.0000,             1.855600000000000,  0.0000,            -0.931438431372549 ,
+        },
+    },
+    { /* BT.2020 */
+        {
+            1.164383561643836,  0.0000,             1.678674107142857, -0.915687932159165 ,
+            1.164383561643836, -0.187326104219343, -0.650424318505057,  0.347458498519301 ,
+            1.164383561643836,  2.141772321428571,  0.0000,            -1.148145075016308 ,
+        }, {
+            1.0000,             0.0000,             1.474600000000000, -0.740191372549020 ,
+            1.0000,            -0.164553126843658, -0.571353126843658,  0.369396080282260 ,
+            1.0000,             1.881400000000000,  0.0000,            -0.944389019607843 ,
+        },
+    },
+};
+
+/* Coefficients of the color matrix of fmt, for the Coefficient uniform */
+static void BuildCoefficients(vout_display_opengl_t *vgl, const video_format_t *fmt)
+{
+    int index = fmt->i_matrix >= JVO_MATRIX_BT601 && fmt->i_matrix <= JVO_MATRIX_BT2020 ?
+                fmt->i_matrix - JVO_MATRIX_BT601 : 0;
+    const float (*matrix) = yuv_matrix[index][fmt->i_range == JVO_RANGE_FULL];
+    float yuv_range_correction = 1.0;
+    GLfloat local_value[16];
+
+    /* Scale 9/10 bit samples back to [0,1] through the coefficients:
+     * r16 textures read v / 65535, the low/high byte split v / 255 */
+    if (IsPlanar16(fmt->i_chroma)) {
+        const vlc_chroma_description_t *dsc = vlc_fourcc_GetChromaDescription(fmt->i_chroma);
+        float max = vgl->tex_format[0] == GL_RED_EXT ? 65535.0 : 255.0;
+        yuv_range_correction = max / ((1 << dsc->pixel_bits) - 1);
+    }
 
     for (int i = 0; i < 4; i++) {
         float correction = i < 3 ? yuv_range_correction : 1.0;
         /* We place coefficient values for coefficient[4] in one array from matrix values.
            Notice that we fill values from top down instead of left to right.*/
         for (int j = 0; j < 4; j++)
-            local_value[*local_count + i*4+j] = j < 3 ? correction * matrix[j*4+i]
-                                                      : 0.0 ;
+            local_value[i*4+j] = j < 3 ? correction * matrix[j*4+i]
+                                       : 0.0 ;
+    }
+
+    if (memcmp(local_value, vgl->local_value, sizeof(local_value))) {
+        memcpy(vgl->local_value, local_value, sizeof(local_value));
+        vgl->uniforms_dirty = 1;
     }
-    (*local_count) += 4;
+}
 
+static void DeleteProgram(vlcgl_state_t *st, vlcgl_program_t *prog)
+{
+    VLCGL_CALL(st, glDeleteProgram(prog->program));
+    for (int i = 0; i < 2; i++)
+        if (prog->shader[i] >= 0)
+            VLCGL_CALL(st, glDeleteShader(prog->shader[i]));
+    free(prog);
+}
 
-    *shader = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(*shader, 1, (const char **)&code, NULL);
-    glCompileShader(*shader);
+static pthread_mutex_t program_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static char *program_binary_dir;
 
-    free(code);
+/* Program binaries on disk: header, then the driver blob */
+#define VLCGL_BINARY_MAGIC 0x504f564a /* "JVOP" */
+#define VLCGL_BINARY_MAX   (4 << 20)
+typedef struct
+{
+    uint32_t magic;
+    uint32_t format;   /* binary format of the driver */
+    uint64_t key;
+    uint32_t length;
+    uint32_t checksum; /* of the blob */
+} vlcgl_binary_header_t;
+
+static uint64_t HashBytes(uint64_t hash, const void *data, size_t size)
+{
+    /* FNV-1a */
+    const uint8_t *p = data;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= p[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
 }
 
-vout_display_opengl_t *vout_display_opengl_New(video_format_t *fmt)
+static uint64_t HashString(uint64_t hash, const char *str)
 {
+    return str ? HashBytes(hash, str, strlen(str) + 1) : hash;
+}
 
-    vout_display_opengl_t *vgl = calloc(1, sizeof(*vgl));
-    if (!vgl)
-        return NULL;
+/* Binaries only load on the driver that wrote them */
+static uint64_t GetProgramKey(vout_display_opengl_t *vgl, const char *fragment)
+{
+    uint64_t key = 0xcbf29ce484222325ULL;
+
+    key = HashString(key, (const char *)VLCGL_CALL(vgl->state, glGetString(GL_VENDOR)));
+    key = HashString(key, (const char *)VLCGL_CALL(vgl->state, glGetString(GL_RENDERER)));
+    key = HashString(key, (const char *)VLCGL_CALL(vgl->state, glGetString(GL_VERSION)));
+    key = HashString(key, vertexShader);
+    key = HashString(key, fragment);
+    return key;
+}
 
-    memset(vgl, 0, sizeof(*vgl));
+static int GetProgramBinaryPath(char *path, size_t size, uint64_t key)
+{
+    int ret = -1;
 
-    float yuv_range_correction = 1.0;
+    pthread_mutex_lock(&program_cache_lock);
+    if (program_binary_dir != NULL) {
+        snprintf(path, size, "%s/jvo-%016llx.bin", program_binary_dir,
+                 (unsigned long long)key);
+        ret = 1;
+    }
+    pthread_mutex_unlock(&program_cache_lock);
+    return ret;
+}
+
+/* Link prog from the binary of key, fails on a missing, corrupt or
+ * rejected file so the caller compiles from source instead */
+static int LoadProgramBinary(vout_display_opengl_t *vgl, vlcgl_program_t *prog, uint64_t key)
+{
+    char path[512];
+    vlcgl_binary_header_t header;
+    void *data = NULL;
+    int ok = 0;
+
+    if (!vgl->supports_program_binary || GetProgramBinaryPath(path, sizeof(path), key) < 0)
+        return -1;
+
+    FILE *file = fopen(path, "rb");
+    if (file == NULL)
+        return -1;
+    if (fread(&header, sizeof(header), 1, file) == 1 &&
+        header.magic == VLCGL_BINARY_MAGIC && header.key == key &&
+        header.length > 0 && header.length <= VLCGL_BINARY_MAX &&
+        (data = malloc(header.length)) != NULL &&
+        fread(data, header.length, 1, file) == 1)
+        ok = (uint32_t)HashBytes(0xcbf29ce484222325ULL, data, header.length) == header.checksum;
+    fclose(file);
+
+    if (ok) {
+        GLint link_status = GL_FALSE;
+
+        prog->program = VLCGL_CALL(vgl->state, glCreateProgram());
+        VLCGL_CALL(vgl->state, vgl->ProgramBinary(prog->program, header.format, data, header.length));
+        VLCGL_CALL(vgl->state, glGetProgramiv(prog->program, GL_LINK_STATUS, &link_status));
+        /* a driver update may refuse the format, do not leave the error around */
+        while (VLCGL_CALL(vgl->state, glGetError()) != GL_NO_ERROR)
+            ;
+        if (link_status == GL_FALSE) {
+            VLCGL_CALL(vgl->state, glDeleteProgram(prog->program));
+            prog->program = 0;
+            ok = 0;
+        }
+    }
+    free(data);
+
+    if (!ok) {
+        LOGI("opengl program binary %s invalid, rebuilding", path);
+        return -1;
+    }
+    return 1;
+}
+
+/* Store the binary of the linked prog for the next start */
+static void SaveProgramBinary(vout_display_opengl_t *vgl, vlcgl_program_t *prog, uint64_t key)
+{
+    char path[512];
+    char temp[520];
+    vlcgl_binary_header_t header;
+    GLint length = 0;
+    GLsizei written = 0;
+    GLenum format = 0;
+
+    if (!vgl->supports_program_binary || GetProgramBinaryPath(path, sizeof(path), key) < 0)
+        return;
+
+    VLCGL_CALL(vgl->state, glGetProgramiv(prog->program, GL_PROGRAM_BINARY_LENGTH, &length));
+    if (length <= 0 || length > VLCGL_BINARY_MAX)
+        return;
+    void *data = malloc(length);
+    if (data == NULL)
+        return;
+    VLCGL_CALL(vgl->state, vgl->GetProgramBinary(prog->program, length, &written, &format, data));
+    if (written <= 0) {
+        free(data);
+        return;
+    }
+
+    header.magic    = VLCGL_BINARY_MAGIC;
+    header.format   = format;
+    header.key      = key;
+    header.length   = written;
+    header.checksum = (uint32_t)HashBytes(0xcbf29ce484222325ULL, data, written);
+
+    /* written aside then renamed, views opening together never read half a file */
+    snprintf(temp, sizeof(temp), "%s.XXXXXX", path);
+    int fd = mkstemp(temp);
+    FILE *file = fd >= 0 ? fdopen(fd, "wb") : NULL;
+    if (file != NULL) {
+        int ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+                 fwrite(data, written, 1, file) == 1;
+        ok = (fclose(file) == 0) && ok;
+        if (!ok || rename(temp, path) != 0)
+            unlink(temp);
+    } else if (fd >= 0) {
+        close(fd);
+        unlink(temp);
+    }
+    free(data);
+}
+
+/* Whether fmt is drawn with the bicubic luma, packed texels have their
+ * own linear luma */
+static int UseBicubic(const vout_display_opengl_t *vgl, const video_format_t *fmt)
+{
+    return vgl->scaler == VLCGL_SCALER_BICUBIC && !IsPacked422(fmt->i_chroma);
+}
+
+/* Link the program drawing fmt->i_chroma, from the binary cache when it
+ * holds one for this driver, from source otherwise */
+static vlcgl_program_t *BuildProgram(vout_display_opengl_t *vgl, const video_format_t *fmt)
+{
+    vlcgl_program_t *prog = calloc(1, sizeof(*prog));
+    if (prog == NULL)
+        return NULL;
+
+    prog->chroma = fmt->i_chroma;
+    prog->sample_format = IsPlanar16(fmt->i_chroma) ? vgl->tex_format[0] : 0;
+    prog->bicubic = UseBicubic(vgl, fmt);
+    prog->shader[0] =
+    prog->shader[1] = -1;
 
-    /* Build program if needed */
-    vgl->program = 0;
-    vgl->shader[0] =
-    vgl->shader[1] =
-    vgl->shader[2] = -1;
-    vgl->local_count = 0;
-  //  if (supports_shaders && (need_fs_yuv || need_fs_xyz|| need_fs_rgba)) {
+    char *fragment = GetYUVFragmentShader(vgl, fmt, prog->bicubic);
+    if (fragment == NULL) {
+        free(prog);
+        return NULL;
+    }
+    uint64_t key = GetProgramKey(vgl, fragment);
 
-        BuildYUVFragmentShader(vgl, &vgl->shader[0], &vgl->local_count,
-                                vgl->local_value, fmt, yuv_range_correction);
-        BuildVertexShader(vgl, &vgl->shader[2]);
+    if (LoadProgramBinary(vgl, prog, key) > 0) {
+        LOGI("opengl program %4.4s loaded", (const char *)&fmt->i_chroma);
+    } else {
+        prog->shader[0] = VLCGL_CALL(vgl->state, glCreateShader(GL_FRAGMENT_SHADER));
+        VLCGL_CALL(vgl->state, glShaderSource(prog->shader[0], 1, (const char **)&fragment, NULL));
+        VLCGL_CALL(vgl->state, glCompileShader(prog->shader[0]));
+        BuildVertexShader(vgl, &prog->shader[1]);
 
 
         /* Check shaders messages */
-        for (unsigned j = 0; j < 3; j++) {
+        for (unsigned j = 0; j < 2; j++) {
             int infoLength;
-            glGetShaderiv(vgl->shader[j], GL_INFO_LOG_LENGTH, &infoLength);
+            if (prog->shader[j] < 0)
+                continue;
+            VLCGL_CALL(vgl->state, glGetShaderiv(prog->shader[j], GL_INFO_LOG_LENGTH, &infoLength));
             if (infoLength <= 1)
                 continue;
 
             char *infolog = malloc(infoLength);
             int charsWritten;
-            glGetShaderInfoLog(vgl->shader[j], infoLength, &charsWritten, infolog);
+            VLCGL_CALL(vgl->state, glGetShaderInfoLog(prog->shader[j], infoLength, &charsWritten, infolog));
+            LOGI("shader %u: %s", j, infolog);
             free(infolog);
         }
 
-        vgl->program = glCreateProgram();
-        glAttachShader(vgl->program, vgl->shader[0]);
-        glAttachShader(vgl->program, vgl->shader[2]);
-        glLinkProgram(vgl->program);
+        prog->program = VLCGL_CALL(vgl->state, glCreateProgram());
+        VLCGL_CALL(vgl->state, glAttachShader(prog->program, prog->shader[0]));
+        VLCGL_CALL(vgl->state, glAttachShader(prog->program, prog->shader[1]));
+        if (vgl->supports_program_binary && vgl->ProgramParameteri)
+            VLCGL_CALL(vgl->state, vgl->ProgramParameteri(prog->program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE));
+        VLCGL_CALL(vgl->state, glLinkProgram(prog->program));
 
 
         /* Check program messages */
 		int infoLength = 0;
-		glGetProgramiv(vgl->program, GL_INFO_LOG_LENGTH, &infoLength);
+		VLCGL_CALL(vgl->state, glGetProgramiv(prog->program, GL_INFO_LOG_LENGTH, &infoLength));
 		char *infolog = malloc(infoLength);
 		int charsWritten;
-		glGetProgramInfoLog(vgl->program, infoLength, &charsWritten, infolog);
+		VLCGL_CALL(vgl->state, glGetProgramInfoLog(prog->program, infoLength, &charsWritten, infolog));
 		free(infolog);
 
 		/* If there is some message, better to check linking is ok */
 		GLint link_status = GL_TRUE;
-		glGetProgramiv(vgl->program, GL_LINK_STATUS, &link_status);
+		VLCGL_CALL(vgl->state, glGetProgramiv(prog->program, GL_LINK_STATUS, &link_status));
 		if (link_status == GL_FALSE) {
 			LOGI("Unable to use program \n");
-			free(vgl);
+			free(fragment);
+			DeleteProgram(vgl->state, prog);
 			return NULL;
 		}
-//	}
 
+        SaveProgramBinary(vgl, prog, key);
+        LOGI("opengl program %4.4s compiled", (const char *)&fmt->i_chroma);
+    }
+    free(fragment);
+
+    prog->uniform_coefficient = VLCGL_CALL(vgl->state, glGetUniformLocation(prog->program, "Coefficient"));
+    prog->uniform_tex_width   = VLCGL_CALL(vgl->state, glGetUniformLocation(prog->program, "TexWidth"));
+    prog->uniform_tex_size    = VLCGL_CALL(vgl->state, glGetUniformLocation(prog->program, "TexSize"));
+    prog->uniform_transform   = VLCGL_CALL(vgl->state, glGetUniformLocation(prog->program, "Transform"));
+    prog->attrib_position     = VLCGL_CALL(vgl->state, glGetAttribLocation(prog->program, "VertexPosition"));
+    for (unsigned j = 0; j < PICTURE_PLANE_MAX; j++) {
+        char name[20];
+        snprintf(name, sizeof(name), "Texture%1u", j);
+        prog->uniform_texture[j] = VLCGL_CALL(vgl->state, glGetUniformLocation(prog->program, name));
+        snprintf(name, sizeof(name), "MultiTexCoord%1u", j);
+        prog->attrib_tex_coord[j] = VLCGL_CALL(vgl->state, glGetAttribLocation(prog->program, name));
+    }
 
-    /* */
-    glDisable(GL_BLEND);
-    glDisable(GL_DEPTH_TEST);
-    glDepthMask(GL_FALSE);
-    glDisable(GL_CULL_FACE);
-    glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
-    glClear(GL_COLOR_BUFFER_BIT);
-
-    return vgl;
+    return prog;
 }
 
-void vout_display_opengl_Delete(vout_display_opengl_t *vgl)
+static vlcgl_program_cache_t *ProgramCacheNew(void)
 {
-	if (vgl == NULL)
-	{
-	   return;
-	}
-
-	glFinish();
-	glFlush();
-	if (vgl->chroma != NULL)
-	{
-		for (int i = 0; i < VLCGL_TEXTURE_COUNT; i++)
-			glDeleteTextures(vgl->chroma->plane_count, vgl->texture[i]);
-	}
-
-
-	if (vgl->program) {
-		glDeleteProgram(vgl->program);
-		for (int i = 0; i < 3; i++)
-			glDeleteShader(vgl->shader[i]);
-	}
-
-	if (vgl->texture_temp_buf != NULL)
-	{
-		free(vgl->texture_temp_buf);
-		vgl->texture_temp_buf = NULL;
-	}
-	
-    free(vgl);
+    vlcgl_program_cache_t *cache = calloc(1, sizeof(*cache));
 
+    if (cache != NULL) {
+        StateReset(&cache->state);
+        cache->state.vertex_array = VLCGL_UNKNOWN;
+    }
+    return cache;
 }
 
-
-#define ALIGN(x, y) (((x) + ((y) - 1)) & ~((y) - 1))
-static void Upload(vout_display_opengl_t *vgl, int in_width, int in_height,
-                   int in_full_width, int in_full_height,
-                   int w_num, int w_den, int h_num, int h_den,
-                   int pitch, int pixel_pitch,
-                   int full_upload, const uint8_t *pixels,
-                   int tex_target, int tex_format, int tex_type)
+static void ProgramCacheDelete(vlcgl_program_cache_t *cache)
 {
-    int width       =       in_width * w_num / w_den;
-    int full_width  =  in_full_width * w_num / w_den;
-    int height      =      in_height * h_num / h_den;
-    int full_height = in_full_height * h_num / h_den;
-
- //   width = full_width = 352;
- //   height = full_height = 288;
-    // This unpack alignment is the default, but setting it just in case.
-    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
-#ifndef GL_UNPACK_ROW_LENGTH
-    int dst_width = full_upload ? full_width : width;
-    int dst_pitch = ALIGN(dst_width * pixel_pitch, 4);
-
-  //  dst_width = dst_pitch = 352;
-
- //   LOGI("upload11: full_upload: %d, height: %d", full_upload, height);
-
-   // dst_pitch = pitch = width;
-    if ( pitch != dst_pitch )
-    {
- //   	LOGI("Upload pitch != dst_pitch %d != %d height: %d", pitch, dst_pitch, height);
-        int buf_size = dst_pitch * full_height * pixel_pitch;
-        const uint8_t *source = pixels;
-        uint8_t *destination;
-        if( !vgl->texture_temp_buf || vgl->texture_temp_buf_size < buf_size )
-        {
-            free( vgl->texture_temp_buf );
-            vgl->texture_temp_buf = malloc( buf_size );
-            vgl->texture_temp_buf_size = buf_size;
-        }
-        destination = vgl->texture_temp_buf;
-
-        for( int h = 0; h < height ; h++ )
-        {
-            memcpy( destination, source, width * pixel_pitch );
-            source += pitch;
-            destination += dst_pitch;
-        }
-        if (full_upload)
-            glTexImage2D( tex_target, 0, tex_format,
-                          full_width, full_height,
-                          0, tex_format, tex_type, vgl->texture_temp_buf );
-        else
-            glTexSubImage2D( tex_target, 0,
-                             0, 0,
-                             width, height,
-                             tex_format, tex_type, vgl->texture_temp_buf );
-    } else {
-#else
-    (void) width;
-    (void) height;
-    (void) vgl;
-    {
+    if (cache == NULL)
+        return;
 
-    	glPixelStorei(GL_UNPACK_ROW_LENGTH, pitch / pixel_pitch);
-#endif
-        if (full_upload)
-        {
-        	glTexImage2D(tex_target, 0, tex_format,
-                         full_width, full_height,
-                         0, tex_format, tex_type, pixels);
-        }
-        else
-            glTexSubImage2D(tex_target, 0,
-                            0, 0,
-                            width, height,
-                            tex_format, tex_type, pixels);
+    while (cache->programs != NULL) {
+        vlcgl_program_t *prog = cache->programs;
+        cache->programs = prog->next;
+        DeleteProgram(&cache->state, prog);
     }
-    
-//    LOGI("opengl pitch Iden two");
-
+    free(cache);
 }
 
-int vout_display_opengl_Prepare(vout_display_opengl_t *vgl, PVO_IN_YUV picture)
+/* Use the program of fmt, compiled on the first use in this context */
+static int SelectProgram(vout_display_opengl_t *vgl, const video_format_t *fmt)
 {
-    /* Update the texture */
-    for (unsigned j = 0; j < vgl->chroma->plane_count; j++) {
-        if (vgl->use_multitexture) {
-            glActiveTexture(GL_TEXTURE0 + j);
-            glClientActiveTexture(GL_TEXTURE0 + j);
-        }
-        glBindTexture(vgl->tex_target, vgl->texture[0][j]);
-
-        Upload(vgl, vgl->fmt.i_width, vgl->fmt.i_height,
-               vgl->fmt.i_width, vgl->fmt.i_height,
-               vgl->chroma->p[j].w.num, vgl->chroma->p[j].w.den, vgl->chroma->p[j].h.num, vgl->chroma->p[j].h.den,
-               picture->p[j].i_pitch, 1, 0, picture->p[j].p_pixels, vgl->tex_target, vgl->tex_format, vgl->tex_type);
+    vlcgl_program_cache_t *cache = vgl->program_cache;
+    int sample_format = IsPlanar16(fmt->i_chroma) ? vgl->tex_format[0] : 0;
+    int bicubic = UseBicubic(vgl, fmt);
+    vlcgl_program_t *prog;
+
+    for (prog = cache->programs; prog != NULL; prog = prog->next)
+        if (prog->chroma == fmt->i_chroma && prog->sample_format == sample_format &&
+            prog->bicubic == bicubic)
+            break;
+
+    if (prog == NULL) {
+        prog = BuildProgram(vgl, fmt);
+        if (prog == NULL)
+            return -1;
+        prog->next = cache->programs;
+        cache->programs = prog;
     }
 
+    if (vgl->prog != prog) {
+        vgl->prog = prog;
+        vgl->uniforms_dirty = 1;
+        vgl->vertex_array_dirty = 1;
+    }
     return 1;
 }
 
-
-static void DrawWithShaders(vout_display_opengl_t *vgl, float *left, float *top, float *right, float *bottom)
+/* Switch the luma filter, VLCGL_SCALER_*. Only the luminance and r16
+ * textures are mipmapped, the others get the bicubic luma instead */
+static int SetScaler(vout_display_opengl_t *vgl, int scaler)
 {
-    glUseProgram(vgl->program);
+    if (scaler == VLCGL_SCALER_MIPMAP &&
+        (!vgl->supports_mipmap ||
+         (vgl->tex_format[0] != GL_LUMINANCE && vgl->tex_format[0] != GL_RED_EXT)))
+        scaler = VLCGL_SCALER_BICUBIC;
+    if (vgl->scaler == scaler)
+        return 1;
+
+    int bicubic = UseBicubic(vgl, &vgl->fmt);
+    vgl->scaler = scaler;
+    if (UseBicubic(vgl, &vgl->fmt) == bicubic)
+        return 1;
+    if (SelectProgram(vgl, &vgl->fmt) > 0)
+        return 1;
+
+    LOGI("opengl bicubic program unavailable");
+    vgl->scaler = VLCGL_SCALER_BILINEAR;
+    return SelectProgram(vgl, &vgl->fmt);
+}
 
-	if (vgl->chroma->plane_count == 3) {
-		glUniform4fv(glGetUniformLocation(vgl->program, "Coefficient"), 4, vgl->local_value);
-		glUniform1i(glGetUniformLocation(vgl->program, "Texture0"), 0);
-		glUniform1i(glGetUniformLocation(vgl->program, "Texture1"), 1);
-		glUniform1i(glGetUniformLocation(vgl->program, "Texture2"), 2);
-	}
-	else if (vgl->chroma->plane_count == 1) {
-		glUniform1i(glGetUniformLocation(vgl->program, "Texture0"), 0);
+static void DeleteImageProgram(vout_display_opengl_t *vgl)
+{
+	if (vgl->image_program) {
+		VLCGL_CALL(vgl->state, glDeleteProgram(vgl->image_program));
+		for (int i = 0; i < 2; i++)
+			VLCGL_CALL(vgl->state, glDeleteShader(vgl->image_shader[i]));
 	}
+	vgl->image_program = 0;
+}
+
+/* Program sampling an external image, the driver does the yuv conversion */
+static int BuildImageProgram(vout_display_opengl_t *vgl)
+{
+    const char *fragmentShader =
+        "#version " GLSL_VERSION "\n"
+        "#extension GL_OES_EGL_image_external : require\n"
+        PRECISION
+        "uniform samplerExternalOES Texture0;"
+        "varying vec4 TexCoord0,TexCoord1,TexCoord2;"
+        "void main(void) {"
+        " gl_FragColor = texture2D(Texture0, TexCoord0.st);"
+        "}";
+
+    vgl->image_shader[0] = VLCGL_CALL(vgl->state, glCreateShader(GL_FRAGMENT_SHADER));
+    VLCGL_CALL(vgl->state, glShaderSource(vgl->image_shader[0], 1, &fragmentShader, NULL));
+    VLCGL_CALL(vgl->state, glCompileShader(vgl->image_shader[0]));
+    BuildVertexShader(vgl, &vgl->image_shader[1]);
+
+    vgl->image_program = VLCGL_CALL(vgl->state, glCreateProgram());
+    VLCGL_CALL(vgl->state, glAttachShader(vgl->image_program, vgl->image_shader[0]));
+    VLCGL_CALL(vgl->state, glAttachShader(vgl->image_program, vgl->image_shader[1]));
+    VLCGL_CALL(vgl->state, glLinkProgram(vgl->image_program));
+
+    GLint link_status = GL_TRUE;
+    VLCGL_CALL(vgl->state, glGetProgramiv(vgl->image_program, GL_LINK_STATUS, &link_status));
+    if (link_status == GL_FALSE) {
+        LOGI("Unable to use external image program");
+        DeleteImageProgram(vgl);
+        return -1;
+    }
+
+    vgl->image_attrib_position  = VLCGL_CALL(vgl->state, glGetAttribLocation(vgl->image_program, "VertexPosition"));
+    vgl->image_attrib_tex_coord = VLCGL_CALL(vgl->state, glGetAttribLocation(vgl->image_program, "MultiTexCoord0"));
+    vgl->image_uniform_transform = VLCGL_CALL(vgl->state, glGetUniformLocation(vgl->image_program, "Transform"));
+    StateUseProgram(vgl->state, vgl->image_program);
+    GLint texture = VLCGL_CALL(vgl->state, glGetUniformLocation(vgl->image_program, "Texture0"));
+    VLCGL_CALL(vgl->state, glUniform1i(texture, 0));
+    return 1;
+}
+
+/* out = a * b, column major mat3 */
+static void MultiplyMatrix(GLfloat *out, const GLfloat *a, const GLfloat *b)
+{
+    for (int c = 0; c < 3; c++)
+        for (int r = 0; r < 3; r++)
+            out[3 * c + r] = a[r]     * b[3 * c] +
+                             a[3 + r] * b[3 * c + 1] +
+                             a[6 + r] * b[3 * c + 2];
+}
+
+/* Combine the orientation, display and user transforms of the quad and
+ * find the part of the picture it leaves on screen */
+static void UpdateTransform(vout_display_opengl_t *vgl)
+{
+    const GLfloat *user = vgl->user_transform;
+    GLfloat *m = vgl->transform;
+    GLfloat placed[9];
+
+    for (int i = 0; i < 3; i++) {
+        placed[i]     = user[i] * vgl->display_scale[0];
+        placed[3 + i] = user[3 + i] * vgl->display_scale[1];
+        placed[6 + i] = user[6 + i];
+    }
+    MultiplyMatrix(m, placed, vgl->orientation);
+    vgl->transform_dirty = 1;
+    vgl->background_dirty = 1;
+
+    /* corners of the view back in picture space, the quad spans [-1,1]
+     * with the top left of the picture at (-1,1) */
+    float det = m[0] * m[4] - m[3] * m[1];
+    vgl->visible[0] = vgl->visible[1] = 0.0;
+    vgl->visible[2] = vgl->visible[3] = 1.0;
+    if (fabsf(det) < 1e-6)
+        return;
+
+    float x0 = 1.0, y0 = 1.0, x1 = 0.0, y1 = 0.0;
+    for (int i = 0; i < 4; i++) {
+        float cx = (i & 1) ? 1.0 : -1.0;
+        float cy = (i & 2) ? 1.0 : -1.0;
+        float dx = cx - m[6], dy = cy - m[7];
+        float bx = ( m[4] * dx - m[3] * dy) / det;
+        float by = (-m[1] * dx + m[0] * dy) / det;
+        float u = (bx + 1.0) / 2.0;
+        float v = (1.0 - by) / 2.0;
+        x0 = fminf(x0, u);
+        y0 = fminf(y0, v);
+        x1 = fmaxf(x1, u);
+        y1 = fmaxf(y1, v);
+    }
+    vgl->visible[0] = fmaxf(x0, 0.0);
+    vgl->visible[1] = fmaxf(y0, 0.0);
+    vgl->visible[2] = fminf(x1, 1.0);
+    vgl->visible[3] = fminf(y1, 1.0);
+}
+
+/* Use matrix (column major mat3, NULL: identity) for the quad */
+static void SetTransform(vout_display_opengl_t *vgl, const float *matrix)
+{
+    static const float identity[9] = { 1, 0, 0,  0, 1, 0,  0, 0, 1 };
+
+    memcpy(vgl->user_transform, matrix ? matrix : identity, sizeof(vgl->user_transform));
+    UpdateTransform(vgl);
+}
+
+/* Rotate the picture by degrees clockwise (0, 90, 180, 270), mirrored
+ * left to right first when mirror is set */
+static void SetOrientation(vout_display_opengl_t *vgl, int degrees, int mirror)
+{
+    /* cos and sin of the clockwise rotation, y points up */
+    int c = degrees == 0 ? 1 : degrees == 180 ? -1 : 0;
+    int s = degrees == 90 ? -1 : degrees == 270 ? 1 : 0;
+    int x = mirror ? -1 : 1;
+    const GLfloat orientation[9] = {
+        x * c, x * s, 0,
+        -s,    c,     0,
+        0,     0,     1,
+    };
+
+    memcpy(vgl->orientation, orientation, sizeof(vgl->orientation));
+    UpdateTransform(vgl);
+}
+
+/* Scale of the quad past the viewport, 1: the picture fits it */
+static void SetDisplayScale(vout_display_opengl_t *vgl, float scale_x, float scale_y)
+{
+    if (vgl->display_scale[0] == scale_x && vgl->display_scale[1] == scale_y)
+        return;
+
+    vgl->display_scale[0] = scale_x;
+    vgl->display_scale[1] = scale_y;
+    UpdateTransform(vgl);
+}
+
+static void SetView(vout_display_opengl_t *vgl, int x, int y, int width, int height,
+                    int surface_width, int surface_height)
+{
+    if (vgl->view[0] == x && vgl->view[1] == y &&
+        vgl->view[2] == width && vgl->view[3] == height &&
+        vgl->surface[0] == surface_width && vgl->surface[1] == surface_height)
+        return;
+
+    vgl->view[0] = x;
+    vgl->view[1] = y;
+    vgl->view[2] = width;
+    vgl->view[3] = height;
+    vgl->surface[0] = surface_width;
+    vgl->surface[1] = surface_height;
+    vgl->background_dirty = 1;
+}
+
+/* Window pixels the quad does not cover: the quad bounds are only known
+ * when the transform keeps it axis aligned, otherwise all is cleared */
+static void UpdateBackground(vout_display_opengl_t *vgl)
+{
+    const GLfloat *m = vgl->transform;
+    const int *v = vgl->view;
+    int sw = vgl->surface[0], sh = vgl->surface[1];
+    float hx, hy;
+
+    vgl->background_dirty = 0;
+    vgl->background_count = -1;
+
+    if (sw <= 0 || sh <= 0 || v[2] <= 0 || v[3] <= 0)
+        return;
+    if (fabsf(m[1]) < 1e-6 && fabsf(m[3]) < 1e-6) {
+        hx = fabsf(m[0]);
+        hy = fabsf(m[4]);
+    } else if (fabsf(m[0]) < 1e-6 && fabsf(m[4]) < 1e-6) {
+        hx = fabsf(m[3]);
+        hy = fabsf(m[1]);
+    } else {
+        return;
+    }
+
+    /* pixels fully inside the quad, the viewport and the window */
+    float x0 = v[0] + (m[6] - hx + 1.0) / 2.0 * v[2];
+    float x1 = v[0] + (m[6] + hx + 1.0) / 2.0 * v[2];
+    float y0 = v[1] + (m[7] - hy + 1.0) / 2.0 * v[3];
+    float y1 = v[1] + (m[7] + hy + 1.0) / 2.0 * v[3];
+    int ix0 = fmaxf(ceilf(fmaxf(x0, v[0])), 0.0);
+    int iy0 = fmaxf(ceilf(fmaxf(y0, v[1])), 0.0);
+    int ix1 = fminf(floorf(fminf(x1, v[0] + v[2])), sw);
+    int iy1 = fminf(floorf(fminf(y1, v[1] + v[3])), sh);
+    if (ix0 >= ix1 || iy0 >= iy1)
+        return;
+
+    /* bands below and above the quad, then left and right of it */
+    const int band[4][4] = {
+        { 0,   0,   sw,       iy0       },
+        { 0,   iy1, sw,       sh - iy1  },
+        { 0,   iy0, ix0,      iy1 - iy0 },
+        { ix1, iy0, sw - ix1, iy1 - iy0 },
+    };
+    vgl->background_count = 0;
+    for (int i = 0; i < 4; i++) {
+        if (band[i][2] <= 0 || band[i][3] <= 0)
+            continue;
+        memcpy(vgl->background[vgl->background_count++], band[i], sizeof(band[i]));
+    }
+}
+
+/* Clear only the bars around the quad; a covered window is invalidated
+ * instead so tiled gpus neither load nor clear it */
+static void ClearBackground(vout_display_opengl_t *vgl)
+{
+    static const GLenum attachment = GL_COLOR_EXT;
+    vlcgl_state_t *st = vgl->state;
+
+    if (vgl->background_dirty)
+        UpdateBackground(vgl);
+    if (vgl->view[2] > 0 && vgl->view[3] > 0)
+        StateViewport(st, vgl->view);
+
+    if (vgl->background_count < 0) {
+        StateScissorTest(st, 0);
+        VLCGL_CALL(st, glClear(GL_COLOR_BUFFER_BIT));
+    } else if (vgl->background_count == 0) {
+        /* no box of the last bars may clip the draw */
+        StateScissorTest(st, 0);
+        if (vgl->InvalidateFramebuffer) {
+            VLCGL_CALL(st, vgl->InvalidateFramebuffer(GL_FRAMEBUFFER, 1, &attachment));
+        }
+    } else {
+        /* the test stays on and the box goes back to the view, which the
+         * draw does not leave; the other clears turn it off. The bars and
+         * the view cover the whole surface, nothing of it is loaded */
+        if (vgl->InvalidateFramebuffer) {
+            VLCGL_CALL(st, vgl->InvalidateFramebuffer(GL_FRAMEBUFFER, 1, &attachment));
+        }
+        StateScissorTest(st, 1);
+        for (int i = 0; i < vgl->background_count; i++) {
+            const int *r = vgl->background[i];
+            VLCGL_CALL(st, glScissor(r[0], r[1], r[2], r[3]));
+            VLCGL_CALL(st, glClear(GL_COLOR_BUFFER_BIT));
+        }
+        VLCGL_CALL(st, glScissor(vgl->view[0], vgl->view[1], vgl->view[2], vgl->view[3]));
+    }
+}
+
+vout_display_opengl_t *vout_display_opengl_New(video_format_t *fmt)
+{
+
+    vout_display_opengl_t *vgl = calloc(1, sizeof(*vgl));
+    if (!vgl)
+        return NULL;
 
+    memset(vgl, 0, sizeof(*vgl));
+
+    vgl->texture_count = VLCGL_TEXTURE_DEFAULT;
+
+    /* Programs are compiled by the first picture of each layout */
+    vgl->program_cache = ProgramCacheNew();
+    if (vgl->program_cache == NULL) {
+        free(vgl);
+        return NULL;
+    }
+    vgl->state = &vgl->program_cache->state;
+
+    /* GLES3 is needed for pixel buffer object uploads */
+    int major = 0;
+    const char *version = (const char *)glGetString(GL_VERSION);
+    if (version != NULL && sscanf(version, "OpenGL ES %d.", &major) == 1 && major >= 3) {
+        vgl->gles3 = 1;
+        vgl->MapBufferRange = (PFN_vglMapBufferRange)eglGetProcAddress("glMapBufferRange");
+        vgl->UnmapBuffer    = (PFN_vglUnmapBuffer)eglGetProcAddress("glUnmapBuffer");
+        vgl->FenceSync      = (PFN_vglFenceSync)eglGetProcAddress("glFenceSync");
+        vgl->ClientWaitSync = (PFN_vglClientWaitSync)eglGetProcAddress("glClientWaitSync");
+        vgl->DeleteSync     = (PFN_vglDeleteSync)eglGetProcAddress("glDeleteSync");
+        vgl->supports_pbo = vgl->MapBufferRange && vgl->UnmapBuffer &&
+                            vgl->FenceSync && vgl->ClientWaitSync && vgl->DeleteSync;
+    }
+    LOGI("opengl version: %s, gles3: %d, pbo: %d", version ? version : "unknown",
+         vgl->gles3, vgl->supports_pbo);
+
+    const char *extensions = (const char *)glGetString(GL_EXTENSIONS);
+    if (HasExtension(extensions, "GL_OES_EGL_image_external"))
+        vgl->EGLImageTargetTexture2DOES = (PFN_vglEGLImageTargetTexture2DOES)
+            eglGetProcAddress("glEGLImageTargetTexture2DOES");
+    if (vgl->gles3) {
+        vgl->GetProgramBinary  = (PFN_vglGetProgramBinary)eglGetProcAddress("glGetProgramBinary");
+        vgl->ProgramBinary     = (PFN_vglProgramBinary)eglGetProcAddress("glProgramBinary");
+        vgl->ProgramParameteri = (PFN_vglProgramParameteri)eglGetProcAddress("glProgramParameteri");
+    } else if (HasExtension(extensions, "GL_OES_get_program_binary")) {
+        vgl->GetProgramBinary  = (PFN_vglGetProgramBinary)eglGetProcAddress("glGetProgramBinaryOES");
+        vgl->ProgramBinary     = (PFN_vglProgramBinary)eglGetProcAddress("glProgramBinaryOES");
+    }
+    if (vgl->GetProgramBinary && vgl->ProgramBinary) {
+        GLint formats = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+        vgl->supports_program_binary = formats > 0;
+    }
+
+    if (vgl->gles3) {
+        vgl->GenVertexArrays    = (PFN_vglGenVertexArrays)eglGetProcAddress("glGenVertexArrays");
+        vgl->DeleteVertexArrays = (PFN_vglDeleteVertexArrays)eglGetProcAddress("glDeleteVertexArrays");
+        vgl->BindVertexArray    = (PFN_vglBindVertexArray)eglGetProcAddress("glBindVertexArray");
+    } else if (HasExtension(extensions, "GL_OES_vertex_array_object")) {
+        vgl->GenVertexArrays    = (PFN_vglGenVertexArrays)eglGetProcAddress("glGenVertexArraysOES");
+        vgl->DeleteVertexArrays = (PFN_vglDeleteVertexArrays)eglGetProcAddress("glDeleteVertexArraysOES");
+        vgl->BindVertexArray    = (PFN_vglBindVertexArray)eglGetProcAddress("glBindVertexArrayOES");
+    }
+    if (vgl->GenVertexArrays && vgl->DeleteVertexArrays && vgl->BindVertexArray) {
+        vgl->GenVertexArrays(1, &vgl->vertex_array);
+        vgl->vertex_array_dirty = 1;
+    } else {
+        /* only the default array in this context */
+        vgl->state->vertex_array = 0;
+    }
 
     static const GLfloat vertexCoord[] = {
             -1.0,  1.0,
@@ -417,360 +1447,1891 @@ static void DrawWithShaders(vout_display_opengl_t *vgl, float *left, float *top,
              1.0,  1.0,
              1.0, -1.0,
     };
+    glGenBuffers(1, &vgl->vertex_buffer);
+    StateBindBuffer(vgl->state, GL_ARRAY_BUFFER, vgl->vertex_buffer);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(vertexCoord), vertexCoord, GL_STATIC_DRAW);
+    glGenBuffers(1, &vgl->tex_coord_buffer);
+    StateBindBuffer(vgl->state, GL_ARRAY_BUFFER, vgl->tex_coord_buffer);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(vgl->tex_coord), NULL, GL_DYNAMIC_DRAW);
+
+    if (HasExtension(extensions, "GL_EXT_disjoint_timer_query")) {
+        vgl->GenQueries          = (PFN_vglGenQueries)eglGetProcAddress("glGenQueriesEXT");
+        vgl->DeleteQueries       = (PFN_vglDeleteQueries)eglGetProcAddress("glDeleteQueriesEXT");
+        vgl->BeginQuery          = (PFN_vglBeginQuery)eglGetProcAddress("glBeginQueryEXT");
+        vgl->EndQuery            = (PFN_vglEndQuery)eglGetProcAddress("glEndQueryEXT");
+        vgl->GetQueryObjectuiv   = (PFN_vglGetQueryObjectuiv)eglGetProcAddress("glGetQueryObjectuivEXT");
+        vgl->GetQueryObjectui64v = (PFN_vglGetQueryObjectui64v)eglGetProcAddress("glGetQueryObjectui64vEXT");
+        vgl->supports_timer_query = vgl->GenQueries && vgl->DeleteQueries &&
+                                    vgl->BeginQuery && vgl->EndQuery &&
+                                    vgl->GetQueryObjectuiv && vgl->GetQueryObjectui64v;
+        if (vgl->supports_timer_query)
+            vgl->GenQueries(VLCGL_TIMER_MAX, vgl->timer_query);
+    }
+
+    if (vgl->gles3)
+        vgl->InvalidateFramebuffer = (PFN_vglInvalidateFramebuffer)
+            eglGetProcAddress("glInvalidateFramebuffer");
+    else if (HasExtension(extensions, "GL_EXT_discard_framebuffer"))
+        vgl->InvalidateFramebuffer = (PFN_vglInvalidateFramebuffer)
+            eglGetProcAddress("glDiscardFramebufferEXT");
+
+    /* whole picture until the first frame sets its own coordinates */
+    for (unsigned j = 0; j < PICTURE_PLANE_MAX; j++) {
+        vgl->right[j]  = 1.0;
+        vgl->bottom[j] = 1.0;
+    }
+    vgl->display_scale[0] = vgl->display_scale[1] = 1.0;
+    vgl->crop_upload = 1;
+    SetOrientation(vgl, 0, 0);
+    SetTransform(vgl, NULL);
+
+    /* */
+    glDisable(GL_BLEND);
+    glDisable(GL_DEPTH_TEST);
+    glDepthMask(GL_FALSE);
+    glDisable(GL_CULL_FACE);
+    glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+    StateScissorTest(vgl->state, 0);
+    glClear(GL_COLOR_BUFFER_BIT);
+
+    return vgl;
+}
+
+static void DeletePBO(vout_display_opengl_t *vgl)
+{
+    for (int i = 0; i < vgl->pbo_count; i++) {
+        if (vgl->pbo_fence[i] != NULL)
+            VLCGL_CALL(vgl->state, vgl->DeleteSync(vgl->pbo_fence[i]));
+        vgl->pbo_fence[i] = NULL;
+
+        VLCGL_CALL(vgl->state, glDeleteBuffers(PICTURE_PLANE_MAX, vgl->pbo[i]));
+        memset(vgl->pbo_size[i], 0, sizeof(vgl->pbo_size[i]));
+    }
+    if (vgl->pbo_count > 0)
+        StateReset(vgl->state);
+    vgl->pbo_count = 0;
+    vgl->pbo_index = 0;
+}
+
+/* (Re)create the pbo ring, count == 0 goes back to direct uploads */
+static void UpdatePBO(vout_display_opengl_t *vgl, int count)
+{
+    if (count < 0)
+        count = 0;
+    if (count > VLCGL_PBO_MAX)
+        count = VLCGL_PBO_MAX;
+    if (!vgl->supports_pbo)
+        count = 0;
+    if (count == vgl->pbo_count)
+        return;
+
+    DeletePBO(vgl);
+
+    for (int i = 0; i < count; i++)
+        VLCGL_CALL(vgl->state, glGenBuffers(PICTURE_PLANE_MAX, vgl->pbo[i]));
+    vgl->pbo_count = count;
+
+    LOGI("opengl pbo upload ring: %d", count);
+}
+
+static void DeleteTexture(vout_display_opengl_t *vgl)
+{
+	if (vgl->chroma != NULL)
+	{
+		for (int i = 0; i < vgl->texture_count; i++)
+			VLCGL_CALL(vgl->state, glDeleteTextures(vgl->chroma->plane_count, vgl->texture[i]));
+		StateReset(vgl->state);
+	}
+	memset(vgl->texture, 0, sizeof(vgl->texture));
+	memset(vgl->mipmap_storage, 0, sizeof(vgl->mipmap_storage));
+	vgl->texture_bytes = 0;
+}
+
+static void PoolEvict(vout_display_opengl_t *vgl, vlcgl_texture_pool_t *entry)
+{
+    for (int i = 0; i < entry->texture_count; i++)
+        VLCGL_CALL(vgl->state, glDeleteTextures(entry->plane_count, entry->texture[i]));
+    StateReset(vgl->state);
+    vgl->pool_bytes -= entry->bytes;
+    memset(entry, 0, sizeof(*entry));
+}
+
+static void PoolClear(vout_display_opengl_t *vgl)
+{
+    for (int i = 0; i < VLCGL_POOL_MAX; i++)
+        if (vgl->pool[i].texture_count > 0)
+            PoolEvict(vgl, &vgl->pool[i]);
+}
+
+/* Park the current texture sets, evicting the least recently used
+ * ones while the pool holds more than VLCGL_POOL_BYTES */
+static void PoolPark(vout_display_opengl_t *vgl)
+{
+    if (vgl->chroma == NULL || vgl->texture[0][0] == 0)
+        return;
+
+    vlcgl_texture_pool_t *entry = &vgl->pool[0];
+    for (int i = 0; i < VLCGL_POOL_MAX; i++) {
+        if (vgl->pool[i].texture_count == 0) {
+            entry = &vgl->pool[i];
+            break;
+        }
+        if (vgl->pool[i].last_use < entry->last_use)
+            entry = &vgl->pool[i];
+    }
+    if (entry->texture_count > 0)
+        PoolEvict(vgl, entry);
+
+    entry->chroma        = vgl->fmt.i_chroma;
+    entry->width         = vgl->fmt.i_width;
+    entry->height        = vgl->fmt.i_height;
+    entry->plane_count   = vgl->chroma->plane_count;
+    entry->texture_count = vgl->texture_count;
+    entry->bytes         = vgl->texture_bytes;
+    entry->last_use      = opengl_mdate();
+    memcpy(entry->texture, vgl->texture, sizeof(entry->texture));
+    memcpy(entry->mipmap_storage, vgl->mipmap_storage, sizeof(entry->mipmap_storage));
+    vgl->pool_bytes += entry->bytes;
+
+    memset(vgl->texture, 0, sizeof(vgl->texture));
+    memset(vgl->mipmap_storage, 0, sizeof(vgl->mipmap_storage));
+    vgl->texture_bytes = 0;
+
+    while (vgl->pool_bytes > VLCGL_POOL_BYTES) {
+        vlcgl_texture_pool_t *lru = NULL;
+        for (int i = 0; i < VLCGL_POOL_MAX; i++)
+            if (vgl->pool[i].texture_count > 0 &&
+                (lru == NULL || vgl->pool[i].last_use < lru->last_use))
+                lru = &vgl->pool[i];
+        PoolEvict(vgl, lru);
+    }
+}
+
+/* Take back parked sets matching the current format, return 1 if found */
+static int PoolTake(vout_display_opengl_t *vgl)
+{
+    for (int i = 0; i < VLCGL_POOL_MAX; i++) {
+        vlcgl_texture_pool_t *e = &vgl->pool[i];
+        if (e->texture_count != vgl->texture_count ||
+            e->chroma != vgl->fmt.i_chroma ||
+            e->width  != vgl->fmt.i_width ||
+            e->height != vgl->fmt.i_height)
+            continue;
+
+        memcpy(vgl->texture, e->texture, sizeof(vgl->texture));
+        memcpy(vgl->mipmap_storage, e->mipmap_storage, sizeof(vgl->mipmap_storage));
+        vgl->texture_bytes = e->bytes;
+        vgl->pool_bytes -= e->bytes;
+        memset(e, 0, sizeof(*e));
+        return 1;
+    }
+    return 0;
+}
+
+static void ResetDirty(vout_display_opengl_t *vgl)
+{
+    for (unsigned j = 0; j < PICTURE_PLANE_MAX; j++) {
+        free(vgl->dirty_shadow[j]);
+        vgl->dirty_shadow[j] = NULL;
+    }
+    free(vgl->dirty_stamp);
+    vgl->dirty_stamp = NULL;
+    vgl->dirty_band_count = 0;
+    memset(vgl->dirty_set_stamp, 0, sizeof(vgl->dirty_set_stamp));
+}
+
+void vout_display_opengl_Delete(vout_display_opengl_t *vgl)
+{
+	if (vgl == NULL)
+	{
+	   return;
+	}
+
+	glFinish();
+	glFlush();
+	DeleteTexture(vgl);
+	PoolClear(vgl);
+
+	DeletePBO(vgl);
+	ResetDirty(vgl);
+	if (vgl->supports_timer_query)
+		vgl->DeleteQueries(VLCGL_TIMER_MAX, vgl->timer_query);
+	if (vgl->vertex_array)
+	{
+		StateDeleteVertexArray(vgl->state, vgl->vertex_array);
+		vgl->DeleteVertexArrays(1, &vgl->vertex_array);
+	}
+	glDeleteBuffers(1, &vgl->vertex_buffer);
+	glDeleteBuffers(1, &vgl->tex_coord_buffer);
+
+	DeleteImageProgram(vgl);
+	if (vgl->image_texture)
+		glDeleteTextures(1, &vgl->image_texture);
+	StateReset(vgl->state);
+	ProgramCacheDelete(vgl->program_cache);
+
+	if (vgl->texture_temp_buf != NULL)
+	{
+		free(vgl->texture_temp_buf);
+		vgl->texture_temp_buf = NULL;
+	}
+	
+    free(vgl);
+
+}
+
+
+#define ALIGN(x, y) (((x) + ((y) - 1)) & ~((y) - 1))
+
+/* Bytes of one row of plane j */
+static inline int GetPlaneBytes(const vout_display_opengl_t *vgl, unsigned j)
+{
+    return vgl->fmt.i_width * vgl->chroma->p[j].w.num / vgl->chroma->p[j].w.den *
+           vgl->chroma->pixel_size;
+}
+
+/* Largest GL_UNPACK_ALIGNMENT that still matches rows of pitch bytes */
+static inline int GetUnpackAlignment(int pitch)
+{
+    return (pitch & 7) == 0 ? 8 : (pitch & 3) == 0 ? 4 : (pitch & 1) == 0 ? 2 : 1;
+}
+
+static void Upload(vout_display_opengl_t *vgl, int x, int y,
+                   int width, int height,
+                   int pitch, int pixel_pitch, const uint8_t *pixels,
+                   int tex_target, int tex_format, int tex_type)
+{
+    vlcgl_state_t *st = vgl->state;
+    int dst_pitch = ALIGN(width * pixel_pitch, 4);
+    int subimage = vgl->supports_unpack_subimage && pitch != dst_pitch &&
+                   (pitch % pixel_pitch) == 0;
+
+    /* client memory, no pbo; rows of dst_pitch unless GL skips the padding */
+    if (vgl->supports_pbo)
+        StateBindBuffer(st, GL_PIXEL_UNPACK_BUFFER, 0);
+    /* the pbo path, GLES3 only, may have left a row length too */
+    if (vgl->supports_unpack_subimage || vgl->supports_pbo)
+        StatePixelStore(st, GL_UNPACK_ROW_LENGTH, subimage ? pitch / pixel_pitch : 0);
+    StatePixelStore(st, GL_UNPACK_ALIGNMENT, subimage ? GetUnpackAlignment(pitch) : 4);
+
+    if (subimage)
+    {
+        /* GLES3 or GL_EXT_unpack_subimage: let GL skip the row padding */
+        VLCGL_CALL(st, glTexSubImage2D(tex_target, 0,
+                                       x, y,
+                                       width, height,
+                                       tex_format, tex_type, pixels));
+    }
+    else if ( pitch != dst_pitch )
+    {
+        int buf_size = dst_pitch * height;
+        const uint8_t *source = pixels;
+        uint8_t *destination;
+        if( !vgl->texture_temp_buf || vgl->texture_temp_buf_size < buf_size )
+        {
+            free( vgl->texture_temp_buf );
+            vgl->texture_temp_buf = memalign( COPY_BUFFER_ALIGN, buf_size );
+            vgl->texture_temp_buf_size = vgl->texture_temp_buf ? buf_size : 0;
+            if( !vgl->texture_temp_buf )
+                return;
+        }
+        destination = vgl->texture_temp_buf;
+
+        CopyPlane( destination, dst_pitch, source, pitch,
+                   width * pixel_pitch, height );
+        VLCGL_CALL(st, glTexSubImage2D( tex_target, 0,
+                                        x, y,
+                                        width, height,
+                                        tex_format, tex_type, vgl->texture_temp_buf ));
+    }
+    else
+    {
+        VLCGL_CALL(st, glTexSubImage2D(tex_target, 0,
+                                       x, y,
+                                       width, height,
+                                       tex_format, tex_type, pixels));
+    }
+}
+
+/* Copy a plane region into the current pbo of the ring and upload from it.
+ * The copy of frame N+1 only waits for the GPU if it is still reading
+ * the same pbo, that is pbo_count frames behind. Regions of one frame sit
+ * at their own offset in the pbo, so they never overwrite each other. */
+static int UploadPBO(vout_display_opengl_t *vgl, unsigned plane, int x, int y,
+                     int width, int height, int pitch, int pixel_pitch,
+                     const uint8_t *pixels,
+                     int tex_target, int tex_format, int tex_type)
+{
+    int offset = y * pitch + x * pixel_pitch;
+    int size = pitch * (height - 1) + width * pixel_pitch;
+    int index = vgl->pbo_index;
+    int buffer_size = pitch * vgl->tex_height[plane];
+
+    if (offset + size > buffer_size || (pitch % pixel_pitch) != 0)
+        return -1;
+
+    /* the pbo stays bound, client memory uploads unbind it */
+    StateBindBuffer(vgl->state, GL_PIXEL_UNPACK_BUFFER, vgl->pbo[index][plane]);
+    if (vgl->pbo_size[index][plane] < buffer_size) {
+        VLCGL_CALL(vgl->state, glBufferData(GL_PIXEL_UNPACK_BUFFER, buffer_size, NULL, GL_STREAM_DRAW));
+        vgl->pbo_size[index][plane] = buffer_size;
+    }
+
+    uint8_t *dst = VLCGL_CALL(vgl->state,
+                              vgl->MapBufferRange(GL_PIXEL_UNPACK_BUFFER, offset, size,
+                                                  GL_MAP_WRITE_BIT |
+                                                  GL_MAP_INVALIDATE_RANGE_BIT |
+                                                  GL_MAP_UNSYNCHRONIZED_BIT));
+    if (dst == NULL)
+        return -1;
+    memcpy(dst, pixels, size);
+    if (!VLCGL_CALL(vgl->state, vgl->UnmapBuffer(GL_PIXEL_UNPACK_BUFFER)))
+        return -1;
+
+    /* Rows keep the decoder pitch, describe it instead of repacking */
+    StatePixelStore(vgl->state, GL_UNPACK_ALIGNMENT, GetUnpackAlignment(pitch));
+    StatePixelStore(vgl->state, GL_UNPACK_ROW_LENGTH, pitch / pixel_pitch);
+    VLCGL_CALL(vgl->state, glTexSubImage2D(tex_target, 0,
+                                           x, y,
+                                           width, height,
+                                           tex_format, tex_type, (const void *)(intptr_t)offset));
+
+    return 1;
+}
+
+static void UploadPlane(vout_display_opengl_t *vgl, unsigned plane, int x, int y,
+                        int width, int height, int pitch, int pixel_pitch,
+                        const uint8_t *pixels)
+{
+    if (width <= 0 || height <= 0)
+        return;
+
+    pixels += y * pitch + x * pixel_pitch;
+    vgl->upload_bytes += width * height * pixel_pitch;
+
+    if (vgl->pbo_count > 0 &&
+        UploadPBO(vgl, plane, x, y, width, height, pitch, pixel_pitch, pixels,
+                  vgl->tex_target, vgl->tex_format[plane], vgl->tex_type) > 0)
+        return;
+
+    Upload(vgl, x, y, width, height, pitch, pixel_pitch, pixels,
+           vgl->tex_target, vgl->tex_format[plane], vgl->tex_type);
+}
+
+/* Mark the bands that changed since the last frame, either from the rects
+ * of the caller or by comparing with a shadow copy of the last frame.
+ * Return the number of bands, or 0 if the frame must be sent in full. */
+static int UpdateDirty(vout_display_opengl_t *vgl, PVO_IN_YUV picture,
+                       const VO_RECT *rects, int rect_count)
+{
+    int band_height = vgl->dirty_band_height;
+    int band_count = (vgl->fmt.i_height + band_height - 1) / band_height;
+    int fresh = 0;
 
+    if (vgl->dirty_stamp == NULL) {
+        vgl->dirty_stamp = calloc(band_count, sizeof(*vgl->dirty_stamp));
+        for (unsigned j = 0; j < vgl->chroma->plane_count; j++) {
+            int w = GetPlaneBytes(vgl, j);
+            int h = vgl->fmt.i_height * vgl->chroma->p[j].h.num / vgl->chroma->p[j].h.den;
+            vgl->dirty_shadow[j] = malloc(w * h);
+            if (vgl->dirty_shadow[j] == NULL)
+                fresh = -1;
+        }
+        if (vgl->dirty_stamp == NULL || fresh < 0) {
+            ResetDirty(vgl);
+            return 0;
+        }
+        vgl->dirty_band_count = band_count;
+        fresh = 1;
+    }
+
+    vgl->dirty_frame++;
+
+    for (int b = 0; b < band_count; b++) {
+        int changed = fresh;
+
+        if (!changed && rects != NULL) {
+            for (int i = 0; i < rect_count && !changed; i++)
+                changed = rects[i].y < (b + 1) * band_height &&
+                          rects[i].y + rects[i].height > b * band_height;
+        }
+
+        for (unsigned j = 0; j < vgl->chroma->plane_count && !changed && rects == NULL; j++) {
+            int w = GetPlaneBytes(vgl, j);
+            int h = vgl->fmt.i_height * vgl->chroma->p[j].h.num / vgl->chroma->p[j].h.den;
+            int y0 = b * band_height * vgl->chroma->p[j].h.num / vgl->chroma->p[j].h.den;
+            int y1 = (b + 1) * band_height * vgl->chroma->p[j].h.num / vgl->chroma->p[j].h.den;
+            if (y1 > h)
+                y1 = h;
+            changed = ComparePlane(vgl->dirty_shadow[j] + y0 * w, w,
+                                   picture->p[j].p_pixels + y0 * picture->p[j].i_pitch,
+                                   picture->p[j].i_pitch, w, y1 - y0);
+        }
+
+        if (!changed)
+            continue;
+
+        /* keep the shadow in sync with what the textures will hold */
+        vgl->dirty_stamp[b] = vgl->dirty_frame;
+        for (unsigned j = 0; j < vgl->chroma->plane_count; j++) {
+            int w = GetPlaneBytes(vgl, j);
+            int h = vgl->fmt.i_height * vgl->chroma->p[j].h.num / vgl->chroma->p[j].h.den;
+            int y0 = b * band_height * vgl->chroma->p[j].h.num / vgl->chroma->p[j].h.den;
+            int y1 = (b + 1) * band_height * vgl->chroma->p[j].h.num / vgl->chroma->p[j].h.den;
+            if (y1 > h)
+                y1 = h;
+            CopyPlane(vgl->dirty_shadow[j] + y0 * w, w,
+                      picture->p[j].p_pixels + y0 * picture->p[j].i_pitch,
+                      picture->p[j].i_pitch, w, y1 - y0);
+        }
+    }
+
+    return band_count;
+}
+
+/* Luma rect sampled by the current texture coordinates, widened by the
+ * guard band and aligned for the subsampled planes.
+ * Return 1 if it is smaller than the picture. */
+static int GetCrop(vout_display_opengl_t *vgl, VO_RECT *crop)
+{
+    int width  = vgl->fmt.i_width;
+    int height = vgl->fmt.i_height;
+
+    crop->x = 0;
+    crop->y = 0;
+    crop->width  = width;
+    crop->height = height;
+    if (!vgl->crop_upload)
+        return 0;
+
+    int x0 = floorf(vgl->visible[0] * width)  - VLCGL_CROP_GUARD;
+    int y0 = floorf(vgl->visible[1] * height) - VLCGL_CROP_GUARD;
+    int x1 = ceilf(vgl->visible[2]  * width)  + VLCGL_CROP_GUARD;
+    int y1 = ceilf(vgl->visible[3]  * height) + VLCGL_CROP_GUARD;
+
+    x0 = x0 < 0 ? 0 : x0 & ~(VLCGL_CROP_GUARD - 1);
+    y0 = y0 < 0 ? 0 : y0 & ~(VLCGL_CROP_GUARD - 1);
+    x1 = ALIGN(x1, VLCGL_CROP_GUARD);
+    y1 = ALIGN(y1, VLCGL_CROP_GUARD);
+    if (x1 > width)
+        x1 = width;
+    if (y1 > height)
+        y1 = height;
+    if (x1 <= x0 || y1 <= y0)
+        return 0;
+
+    crop->x = x0;
+    crop->y = y0;
+    crop->width  = x1 - x0;
+    crop->height = y1 - y0;
+
+    return crop->width < width || crop->height < height;
+}
+
+int vout_display_opengl_Prepare(vout_display_opengl_t *vgl, PVO_IN_YUV picture,
+                                const VO_RECT *rects, int rect_count)
+{
+    int index = vgl->pbo_index;
+    int band_count = 0;
+    int64_t set_stamp;
+    VO_RECT crop;
+    int cropped;
+
+    /* The GPU may still be reading the pbo we are about to overwrite */
+    if (vgl->pbo_count > 0 && vgl->pbo_fence[index] != NULL) {
+        VLCGL_CALL(vgl->state, vgl->ClientWaitSync(vgl->pbo_fence[index],
+                                                   GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000ULL));
+        VLCGL_CALL(vgl->state, vgl->DeleteSync(vgl->pbo_fence[index]));
+        vgl->pbo_fence[index] = NULL;
+    }
+
+    /* Upload into the least recently drawn texture set */
+    vgl->texture_index = (vgl->texture_index + 1) % vgl->texture_count;
+    vgl->upload_bytes = 0;
+
+    /* A texture set only needs the bands that changed since it was filled */
+    if (vgl->dirty_band_height > 0)
+        band_count = UpdateDirty(vgl, picture, rects, rect_count);
+    set_stamp = vgl->dirty_set_stamp[vgl->texture_index];
+    if (set_stamp == 0)
+        band_count = 0;
+
+    /* Zoomed in, a set only needs the visible part, but is sent in full
+     * after a zoom change so that no stale texel becomes visible */
+    cropped = GetCrop(vgl, &crop);
+    if (memcmp(&crop, &vgl->crop, sizeof(crop)) != 0) {
+        vgl->crop = crop;
+        vgl->crop_generation++;
+    }
+    if (vgl->crop_set_generation[vgl->texture_index] != vgl->crop_generation) {
+        vgl->crop_set_generation[vgl->texture_index] = vgl->crop_generation;
+        cropped = 0;
+        band_count = 0;
+    }
+
+    /* Update the texture */
     for (unsigned j = 0; j < vgl->chroma->plane_count; j++) {
-        const GLfloat textureCoord[] = {
-            left[j],  top[j],
-            left[j],  bottom[j],
-            right[j], top[j],
-            right[j], bottom[j],
-        };
-        glActiveTexture(GL_TEXTURE0+j);
-        glClientActiveTexture(GL_TEXTURE0+j);
-        glBindTexture(vgl->tex_target, vgl->texture[0][j]);
+        int pixel_size = vgl->tex_pixel_size[j];
+        int w = GetPlaneBytes(vgl, j) / pixel_size;
+        int h = vgl->fmt.i_height * vgl->chroma->p[j].h.num / vgl->chroma->p[j].h.den;
+        int cx = 0, cy = 0, cw = w, ch = h;
+
+        if (cropped) {
+            cx = crop.x * w / (int)vgl->fmt.i_width;
+            cy = crop.y * h / (int)vgl->fmt.i_height;
+            cw = (crop.x + crop.width)  * w / (int)vgl->fmt.i_width  - cx;
+            ch = (crop.y + crop.height) * h / (int)vgl->fmt.i_height - cy;
+        }
+
+        StateEditTexture(vgl->state, vgl->use_multitexture ? j : 0,
+                         vgl->tex_target, vgl->texture[vgl->texture_index][j]);
+
+        if (band_count == 0) {
+            UploadPlane(vgl, j, cx, cy, cw, ch,
+                        picture->p[j].i_pitch, pixel_size, picture->p[j].p_pixels);
+            continue;
+        }
 
-        char attribute[20];
-        snprintf(attribute, sizeof(attribute), "MultiTexCoord%1d", j);
-        glEnableVertexAttribArray(glGetAttribLocation(vgl->program, attribute));
-        glVertexAttribPointer(glGetAttribLocation(vgl->program, attribute), 2, GL_FLOAT, 0, 0, textureCoord);
+        /* one glTexSubImage2D per run of consecutive dirty bands */
+        for (int b = 0; b < band_count; b++) {
+            int first = b;
+
+            while (b < band_count && vgl->dirty_stamp[b] > set_stamp)
+                b++;
+            if (b == first)
+                continue;
+
+            int y0 = first * vgl->dirty_band_height * vgl->chroma->p[j].h.num / vgl->chroma->p[j].h.den;
+            int y1 = b * vgl->dirty_band_height * vgl->chroma->p[j].h.num / vgl->chroma->p[j].h.den;
+            if (y0 < cy)
+                y0 = cy;
+            if (y1 > cy + ch)
+                y1 = cy + ch;
+            UploadPlane(vgl, j, cx, y0, cw, y1 - y0,
+                        picture->p[j].i_pitch, pixel_size, picture->p[j].p_pixels);
+        }
     }
-    glActiveTexture(GL_TEXTURE0 + 0);
-    glClientActiveTexture(GL_TEXTURE0 + 0);
-    glEnableVertexAttribArray(glGetAttribLocation(vgl->program, "VertexPosition"));
-    glVertexAttribPointer(glGetAttribLocation(vgl->program, "VertexPosition"), 2, GL_FLOAT, 0, 0, vertexCoord);
 
-    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+    /* a set filled without dirty tracking must be sent in full next time */
+    vgl->dirty_set_stamp[vgl->texture_index] =
+        vgl->dirty_stamp != NULL ? vgl->dirty_frame : 0;
+
+    if (vgl->pbo_count > 0) {
+        vgl->pbo_fence[index] = VLCGL_CALL(vgl->state, vgl->FenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0));
+        vgl->pbo_index = (index + 1) % vgl->pbo_count;
+    }
+
+    return 1;
 }
 
-int BuildTexture(vout_display_opengl_t *vgl, video_format_t *fmt)
+/* Start timing the gpu work of a frame, skipped while the query of the slot
+ * has not been read back yet */
+static void TimerBegin(vout_display_opengl_t *vgl)
 {
-    const char *extensions = (const char *)glGetString(GL_EXTENSIONS);
+    int index = vgl->timer_index;
 
-    int supports_shaders = 1;
+    vgl->timer_active = 0;
+    if (!vgl->supports_timer_query || vgl->timer_pending[index])
+        return;
 
-    vgl->supports_npot = HasExtension(extensions, "GL_ARB_texture_non_power_of_two") ||
-                         HasExtension(extensions, "GL_APPLE_texture_2D_limited_npot");
-    vgl->supports_npot = 1;
+    VLCGL_CALL(vgl->state, vgl->BeginQuery(GL_TIME_ELAPSED_EXT, vgl->timer_query[index]));
+    vgl->timer_active = 1;
+}
 
-    GLint max_texture_units = 0;
-    glGetIntegerv(GL_MAX_TEXTURE_IMAGE_UNITS, &max_texture_units);
-    
-    /* Initialize with default chroma */
-    vgl->fmt = *fmt;
+static void TimerEnd(vout_display_opengl_t *vgl)
+{
+    if (!vgl->timer_active)
+        return;
 
-    vgl->fmt.i_chroma = VLC_CODEC_YV12;
-    vgl->tex_target   = GL_TEXTURE_2D;
-    vgl->tex_format   = GL_RGBA;
-    vgl->tex_internal = GL_RGBA;
-    vgl->tex_type     = GL_UNSIGNED_BYTE;
+    VLCGL_CALL(vgl->state, vgl->EndQuery(GL_TIME_ELAPSED_EXT));
+    vgl->timer_pending[vgl->timer_index] = 1;
+    vgl->timer_index = (vgl->timer_index + 1) % VLCGL_TIMER_MAX;
+    vgl->timer_active = 0;
+}
 
+/* Gpu time in microseconds of the newest frame whose query completed since
+ * the last call, -1 if none did. Never waits for the gpu. */
+static int TimerPoll(vout_display_opengl_t *vgl)
+{
+    int us = -1;
+
+    if (!vgl->supports_timer_query)
+        return -1;
+
+    /* oldest first, queries complete in order */
+    for (int i = 0; i < VLCGL_TIMER_MAX; i++) {
+        int index = (vgl->timer_index + i) % VLCGL_TIMER_MAX;
+        GLuint available = 0;
+        uint64_t ns = 0;
+
+        if (!vgl->timer_pending[index])
+            continue;
+        VLCGL_CALL(vgl->state, vgl->GetQueryObjectuiv(vgl->timer_query[index], GL_QUERY_RESULT_AVAILABLE_EXT, &available));
+        if (!available)
+            break;
+        VLCGL_CALL(vgl->state, vgl->GetQueryObjectui64v(vgl->timer_query[index], GL_QUERY_RESULT_EXT, &ns));
+        vgl->timer_pending[index] = 0;
+        us = (int)(ns / 1000);
+    }
+
+    /* a frequency change or a context loss makes the results meaningless */
+    GLint disjoint = 0;
+    VLCGL_CALL(vgl->state, glGetIntegerv(GL_GPU_DISJOINT_EXT, &disjoint));
+    if (disjoint)
+        return -1;
+
+    return us;
+}
+
+/* Uniforms that only change with the program, the color matrix or the
+ * texture size; they stay in the program object between frames */
+static void UpdateUniforms(vout_display_opengl_t *vgl)
+{
+    vlcgl_program_t *prog = vgl->prog;
+
+    if (prog->uniform_coefficient >= 0)
+        VLCGL_CALL(vgl->state, glUniform4fv(prog->uniform_coefficient, 4, vgl->local_value));
+    for (unsigned j = 0; j < vgl->chroma->plane_count; j++)
+        VLCGL_CALL(vgl->state, glUniform1i(prog->uniform_texture[j], j));
+    if (prog->uniform_tex_width >= 0)
+        VLCGL_CALL(vgl->state, glUniform1f(prog->uniform_tex_width, vgl->tex_width[0]));
+    if (prog->uniform_tex_size >= 0)
+        VLCGL_CALL(vgl->state, glUniform2f(prog->uniform_tex_size, vgl->tex_width[0], vgl->tex_height[0]));
+    VLCGL_CALL(vgl->state, glUniformMatrix3fv(prog->uniform_transform, 1, GL_FALSE, vgl->transform));
+
+    vgl->uniforms_dirty = 0;
+    vgl->transform_dirty = 0;
+}
+
+/* Bytes of the luma levels below the base one */
+static int GetMipmapBytes(const vout_display_opengl_t *vgl)
+{
+    int bytes = 0;
+    for (int w = vgl->tex_width[0], h = vgl->tex_height[0]; w > 1 || h > 1; ) {
+        w = w > 1 ? w / 2 : 1;
+        h = h > 1 ? h / 2 : 1;
+        bytes += w * h * vgl->tex_pixel_size[0];
+    }
+    return bytes;
+}
+
+/* Trilinear luma of the set about to be drawn, the levels are generated
+ * again only when the frame changed it */
+static void UpdateMipmaps(vout_display_opengl_t *vgl)
+{
+    int i = vgl->texture_index;
+    int mipmap = vgl->scaler == VLCGL_SCALER_MIPMAP;
+
+    if (vgl->upload_bytes > 0)
+        vgl->mipmap_valid[i] = 0;
+    if (mipmap == vgl->mipmap_filter[i] && (!mipmap || vgl->mipmap_valid[i]))
+        return;
+
+    StateEditTexture(vgl->state, 0, vgl->tex_target, vgl->texture[i][0]);
+    if (mipmap && !vgl->mipmap_valid[i]) {
+        VLCGL_CALL(vgl->state, glGenerateMipmap(vgl->tex_target));
+        vgl->mipmap_valid[i] = 1;
+        if (!vgl->mipmap_storage[i]) {
+            vgl->mipmap_storage[i] = 1;
+            vgl->texture_bytes += GetMipmapBytes(vgl);
+        }
+    }
+    if (mipmap != vgl->mipmap_filter[i]) {
+        VLCGL_CALL(vgl->state, glTexParameteri(vgl->tex_target, GL_TEXTURE_MIN_FILTER,
+                                               mipmap ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR));
+        vgl->mipmap_filter[i] = mipmap;
+    }
+}
+
+/* Rewrite the texture coordinates of count planes when the view moved */
+static void UpdateTexCoords(vout_display_opengl_t *vgl, unsigned count,
+                            const float *left, const float *top,
+                            const float *right, const float *bottom)
+{
+    GLfloat coord[PICTURE_PLANE_MAX][8];
+    size_t size = count * sizeof(coord[0]);
+
+    for (unsigned j = 0; j < count; j++) {
+        const GLfloat textureCoord[] = {
+            left[j],  top[j],
+            left[j],  bottom[j],
+            right[j], top[j],
+            right[j], bottom[j],
+        };
+        memcpy(coord[j], textureCoord, sizeof(textureCoord));
+    }
+
+    if (vgl->tex_coord_valid && !memcmp(coord, vgl->tex_coord, size))
+        return;
+
+    StateBindBuffer(vgl->state, GL_ARRAY_BUFFER, vgl->tex_coord_buffer);
+    VLCGL_CALL(vgl->state, glBufferSubData(GL_ARRAY_BUFFER, 0, size, coord));
+    memcpy(vgl->tex_coord, coord, size);
+    vgl->tex_coord_valid = 1;
+}
+
+/* Point the attributes of the program at the vertex buffers */
+static void SetupAttributes(vout_display_opengl_t *vgl)
+{
+    vlcgl_program_t *prog = vgl->prog;
+
+    for (unsigned j = 0; j < vgl->chroma->plane_count; j++)
+        StateAttribPointer(vgl->state, prog->attrib_tex_coord[j], vgl->tex_coord_buffer,
+                           j * sizeof(vgl->tex_coord[0]));
+    StateAttribPointer(vgl->state, prog->attrib_position, vgl->vertex_buffer, 0);
+}
+
+static void BindVertexArray(vout_display_opengl_t *vgl, GLuint array)
+{
+    if (vgl->state->vertex_array == array)
+        return;
+    VLCGL_CALL(vgl->state, vgl->BindVertexArray(array));
+    vgl->state->vertex_array = array;
+}
+
+static void DrawWithShaders(vout_display_opengl_t *vgl, float *left, float *top, float *right, float *bottom)
+{
+    vlcgl_state_t *st = vgl->state;
+
+    StateUseProgram(st, vgl->prog->program);
+
+    if (vgl->uniforms_dirty)
+        UpdateUniforms(vgl);
+    else if (vgl->transform_dirty) {
+        VLCGL_CALL(st, glUniformMatrix3fv(vgl->prog->uniform_transform, 1, GL_FALSE, vgl->transform));
+        vgl->transform_dirty = 0;
+    }
+
+    UpdateTexCoords(vgl, vgl->chroma->plane_count, left, top, right, bottom);
+
+    if (vgl->vertex_array == 0) {
+        SetupAttributes(vgl);
+    } else if (vgl->vertex_array_dirty) {
+        /* the new program may use other locations, start from a clean array */
+        StateDeleteVertexArray(st, vgl->vertex_array);
+        VLCGL_CALL(st, vgl->DeleteVertexArrays(1, &vgl->vertex_array));
+        VLCGL_CALL(st, vgl->GenVertexArrays(1, &vgl->vertex_array));
+        BindVertexArray(vgl, vgl->vertex_array);
+        SetupAttributes(vgl);
+        vgl->vertex_array_dirty = 0;
+    } else {
+        BindVertexArray(vgl, vgl->vertex_array);
+    }
+
+    for (unsigned j = 0; j < vgl->chroma->plane_count; j++)
+        StateBindTexture(st, j, vgl->tex_target, vgl->texture[vgl->texture_index][j]);
+
+    VLCGL_CALL(st, glDrawArrays(GL_TRIANGLE_STRIP, 0, 4));
+}
+
+/* Attach an EGLImage to the external texture, nothing is copied */
+static int vout_display_opengl_PrepareImage(vout_display_opengl_t *vgl, void *image)
+{
+    if (vgl->EGLImageTargetTexture2DOES == NULL)
+        return -1;
+    if (vgl->image_program == 0 && BuildImageProgram(vgl) < 0)
+        return -1;
+
+    if (vgl->image_texture == 0) {
+        VLCGL_CALL(vgl->state, glGenTextures(1, &vgl->image_texture));
+        StateEditTexture(vgl->state, 0, GL_TEXTURE_EXTERNAL_OES, vgl->image_texture);
+        VLCGL_CALL(vgl->state, glTexParameteri(GL_TEXTURE_EXTERNAL_OES, GL_TEXTURE_MAG_FILTER, GL_LINEAR));
+        VLCGL_CALL(vgl->state, glTexParameteri(GL_TEXTURE_EXTERNAL_OES, GL_TEXTURE_MIN_FILTER, GL_LINEAR));
+        VLCGL_CALL(vgl->state, glTexParameteri(GL_TEXTURE_EXTERNAL_OES, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE));
+        VLCGL_CALL(vgl->state, glTexParameteri(GL_TEXTURE_EXTERNAL_OES, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE));
+    }
+    StateEditTexture(vgl->state, 0, GL_TEXTURE_EXTERNAL_OES, vgl->image_texture);
+    VLCGL_CALL(vgl->state, vgl->EGLImageTargetTexture2DOES(GL_TEXTURE_EXTERNAL_OES, image));
+    if (VLCGL_CALL(vgl->state, glGetError()) != GL_NO_ERROR)
+        return -1;
+
+    return 1;
+}
+
+static void DrawImage(vout_display_opengl_t *vgl)
+{
+    GLint coord = vgl->image_attrib_tex_coord;
+    GLint position = vgl->image_attrib_position;
+
+    static const float zero[PICTURE_PLANE_MAX] = { 0.0, 0.0, 0.0 };
+    static const float one[PICTURE_PLANE_MAX]  = { 1.0, 1.0, 1.0 };
+
+    StateUseProgram(vgl->state, vgl->image_program);
+    VLCGL_CALL(vgl->state, glUniformMatrix3fv(vgl->image_uniform_transform, 1, GL_FALSE, vgl->transform));
+
+    StateBindTexture(vgl->state, 0, GL_TEXTURE_EXTERNAL_OES, vgl->image_texture);
+
+    /* rare path, set up in the default array */
+    UpdateTexCoords(vgl, 1, zero, zero, one, one);
+    if (vgl->vertex_array)
+        BindVertexArray(vgl, 0);
+    StateAttribPointer(vgl->state, coord, vgl->tex_coord_buffer, 0);
+    StateAttribPointer(vgl->state, position, vgl->vertex_buffer, 0);
+
+    VLCGL_CALL(vgl->state, glDrawArrays(GL_TRIANGLE_STRIP, 0, 4));
+}
+
+int BuildTexture(vout_display_opengl_t *vgl, video_format_t *fmt)
+{
+    const char *extensions = (const char *)VLCGL_CALL(vgl->state, glGetString(GL_EXTENSIONS));
+
+    int supports_shaders = 1;
+
+    vgl->supports_npot = HasExtension(extensions, "GL_ARB_texture_non_power_of_two") ||
+                         HasExtension(extensions, "GL_APPLE_texture_2D_limited_npot");
+    vgl->supports_npot = 1;
+
+    /* Strided uploads, probed once per context instead of at compile time */
+    vgl->supports_unpack_subimage = vgl->gles3 ||
+                                    HasExtension(extensions, "GL_EXT_unpack_subimage");
+    vgl->supports_norm16 = vgl->gles3 &&
+                           HasExtension(extensions, "GL_EXT_texture_norm16");
+    /* npot textures are only mipmapped by GLES3 */
+    vgl->supports_mipmap = vgl->gles3 || HasExtension(extensions, "GL_OES_texture_npot");
+
+    GLint max_texture_units = 0;
+    VLCGL_CALL(vgl->state, glGetIntegerv(GL_MAX_TEXTURE_IMAGE_UNITS, &max_texture_units));
+    
+    /* Keep the sets of the previous format around for a switch back */
+    PoolPark(vgl);
+
+    /* Initialize with default chroma */
+    vgl->fmt = *fmt;
+
+    ResetDirty(vgl);
+
+    vgl->fmt.i_chroma = VLC_CODEC_YV12;
+    vgl->tex_target   = GL_TEXTURE_2D;
+    vgl->tex_type     = GL_UNSIGNED_BYTE;
+    for (unsigned j = 0; j < PICTURE_PLANE_MAX; j++) {
+        vgl->tex_format[j]     = GL_RGBA;
+        vgl->tex_internal[j]   = GL_RGBA;
+        vgl->tex_pixel_size[j] = 4;
+    }
+
+
+//	LOGI("max_texture_units = %d, supports_shaders: %d",max_texture_units, supports_shaders);
+
+    if (max_texture_units >= 2 && supports_shaders &&
+        (fmt->i_chroma == VLC_CODEC_NV12 || fmt->i_chroma == VLC_CODEC_NV21)) {
+        /* Luma plane plus one luminance/alpha plane of interleaved chroma,
+         * uploaded as the decoder wrote it */
+        vgl->fmt = *fmt;
+        vgl->tex_format[0]     = GL_LUMINANCE;
+        vgl->tex_internal[0]   = GL_LUMINANCE;
+        vgl->tex_pixel_size[0] = 1;
+        vgl->tex_format[1]     = GL_LUMINANCE_ALPHA;
+        vgl->tex_internal[1]   = GL_LUMINANCE_ALPHA;
+        vgl->tex_pixel_size[1] = 2;
+    }
+    else if (max_texture_units >= 3 && supports_shaders && IsPlanar16(fmt->i_chroma)) {
+        /* 16 bit texels as sent by the decoder, no cpu down-conversion */
+        vgl->fmt = *fmt;
+        for (unsigned j = 0; j < PICTURE_PLANE_MAX; j++) {
+            vgl->tex_format[j]     = vgl->supports_norm16 ? GL_RED_EXT : GL_LUMINANCE_ALPHA;
+            vgl->tex_internal[j]   = vgl->supports_norm16 ? GL_R16_EXT : GL_LUMINANCE_ALPHA;
+            vgl->tex_pixel_size[j] = 2;
+        }
+        vgl->tex_type = vgl->supports_norm16 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_BYTE;
+    }
+    else if (supports_shaders && IsPacked422(fmt->i_chroma)) {
+        /* Sent as is, two pixels per rgba texel, unpacked by the shader */
+        vgl->fmt = *fmt;
+        vgl->tex_format[0]     = GL_RGBA;
+        vgl->tex_internal[0]   = GL_RGBA;
+        vgl->tex_pixel_size[0] = 4;
+    }
+    else if (max_texture_units >= 3 && supports_shaders && vlc_fourcc_IsYUV(fmt->i_chroma)) {
+        const vlc_fourcc_t *list = vlc_fourcc_GetYUVFallback(fmt->i_chroma);
+        while (*list) {
+            const vlc_chroma_description_t *dsc = vlc_fourcc_GetChromaDescription(*list);
+            if (dsc && dsc->plane_count == 3 && dsc->pixel_size == 1) {
+                vgl->fmt          = *fmt;
+                vgl->fmt.i_chroma = *list;
+                for (unsigned j = 0; j < PICTURE_PLANE_MAX; j++) {
+                    vgl->tex_format[j]     = GL_LUMINANCE;
+                    vgl->tex_internal[j]   = GL_LUMINANCE;
+                    vgl->tex_pixel_size[j] = 1;
+                }
+                vgl->tex_type     = GL_UNSIGNED_BYTE;
+                break;
+            }
+            list++;
+        }
+    }
+
+    /* The program follows the plane layout and the order of u and v,
+     * the coefficients the colorimetry of the stream */
+    if (SelectProgram(vgl, &vgl->fmt) < 0)
+        return -1;
+    BuildCoefficients(vgl, &vgl->fmt);
+    
+
+    vgl->chroma = vlc_fourcc_GetChromaDescription(vgl->fmt.i_chroma);
+    vgl->use_multitexture = vgl->chroma->plane_count > 1;
+   
+    /* Texture size */
+    vgl->texture_bytes = 0;
+    for (unsigned j = 0; j < vgl->chroma->plane_count; j++) {
+        int w = GetPlaneBytes(vgl, j) / vgl->tex_pixel_size[j];
+        int h = vgl->fmt.i_height * vgl->chroma->p[j].h.num / vgl->chroma->p[j].h.den;
+        if (vgl->supports_npot) {
+            vgl->tex_width[j]  = w;
+            vgl->tex_height[j] = h;
+        } else {
+            vgl->tex_width[j]  = GetAlignedSize(w);
+            vgl->tex_height[j] = GetAlignedSize(h);
+        }
+        vgl->right[j]  = (float)w / vgl->tex_width[j];
+        vgl->bottom[j] = vgl->fmt.i_height * (float)vgl->chroma->p[j].h.num /
+                         vgl->chroma->p[j].h.den / vgl->tex_height[j];
+        vgl->texture_bytes += vgl->texture_count *
+                              vgl->tex_width[j] * vgl->tex_height[j] * vgl->tex_pixel_size[j];
+    }
+
+    /* the storage below is allocated, nothing read from a pbo */
+    if (vgl->supports_pbo)
+        StateBindBuffer(vgl->state, GL_PIXEL_UNPACK_BUFFER, 0);
+
+    memset(vgl->mipmap_storage, 0, sizeof(vgl->mipmap_storage));
+    if (PoolTake(vgl)) {
+        LOGI("opengl reuse textures %ux%u", vgl->fmt.i_width, vgl->fmt.i_height);
+    }
+    else for (int i = 0; i < vgl->texture_count; i++) {
+        VLCGL_CALL(vgl->state, glGenTextures(vgl->chroma->plane_count, vgl->texture[i]));
+        for (unsigned j = 0; j < vgl->chroma->plane_count; j++) {
+            StateEditTexture(vgl->state, vgl->use_multitexture ? j : 0,
+                             vgl->tex_target, vgl->texture[i][j]);
+
+
+            VLCGL_CALL(vgl->state, glTexParameteri(vgl->tex_target, GL_TEXTURE_MAG_FILTER, GL_LINEAR));
+            VLCGL_CALL(vgl->state, glTexParameteri(vgl->tex_target, GL_TEXTURE_MIN_FILTER, GL_LINEAR));
+            VLCGL_CALL(vgl->state, glTexParameteri(vgl->tex_target, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE));
+            VLCGL_CALL(vgl->state, glTexParameteri(vgl->tex_target, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE));
+
+            /* Call glTexImage2D only once, and use glTexSubImage2D later */
+            VLCGL_CALL(vgl->state, glTexImage2D(vgl->tex_target, 0,
+                                                vgl->tex_internal[j], vgl->tex_width[j], vgl->tex_height[j],
+                                                0, vgl->tex_format[j], vgl->tex_type, NULL));
+        }
+    }
+
+    vgl->texture_index = vgl->texture_count - 1;
+    vgl->uniforms_dirty = 1;
+    for (int i = 0; i < VLCGL_TEXTURE_MAX; i++) {
+        vgl->mipmap_valid[i] = 0;
+        vgl->mipmap_filter[i] = -1;
+    }
+
+    /* new or reused textures, every set is sent in full first */
+    vgl->crop_generation++;
+
+    *fmt = vgl->fmt;
+
+	return 1;
+}
+
+#define OPENGL_DRAW_NONE    0
+#define OPENGL_DRAW_PICTURE 1	/* the yuv texture set of the last picture */
+#define OPENGL_DRAW_IMAGE   2	/* the external texture of the last egl image */
+
+typedef struct _OPENGL
+{
+	video_format_t 				fmt;
+	vout_display_opengl_t *		vgl;
+	double						distance;
+	float						x1;
+	float						y1;
+	float						x2;
+	float						y2;
+	float						scale;
+	float						off_x;
+	float						off_y;
+	float						transform[9];	/* of opengl_set_transform, the pinch zooms it */
+	int							pbo_count;
+	int							texture_count;
+	int							dirty_band_height;
+	VO_RECT *					dirty_rects;
+	int							dirty_rect_count;
+	int							dirty_rect_max;
+	int							upload_us;
+	int							draw_us;
+	int							gpu_us;		/* -1: no gpu result arrived this frame */
+	int							gl_calls;	/* gl calls of the last frame, -1: not counted */
+	int							last_draw;	/* OPENGL_DRAW_*, what opengl_redraw draws again */
+	unsigned int				src_width;	/* picture size the textures are built for */
+	unsigned int				src_height;
+	int							decimation_max;
+	int							decimation;
+	VO_IN_YUV					decimated;
+	uint8_t *					decimate_buf;
+	int							decimate_buf_size;
+	int							scale_quality;
+	int							display_mode;
+	int							display_dirty;	/* view, window, mode or rotation changed */
+	int							rotation;		/* degrees clockwise */
+	int							area[4];		/* view rect the picture is placed in */
+	int							surface[2];
+	unsigned int				display_width;	/* picture size the view was resolved for */
+	unsigned int				display_height;
+}OPENGL, *POPENGL;
+
+
+
+
+OPENGL_HANDLE opengl_open(int width, int height)
+{
+
+	OPENGL_HANDLE h = NULL;
+
+    h = malloc(sizeof(OPENGL));
+    if (h == NULL)
+    {
+    	goto fail;
+    }
+    memset(h, 0, sizeof(OPENGL));
+
+    memset(&h->fmt, 0, sizeof(video_format_t));
+	
+	h->scale = 1.0;
+	h->transform[0] = h->transform[4] = h->transform[8] = 1.0;
+	h->texture_count = VLCGL_TEXTURE_DEFAULT;
+	h->dirty_rect_count = -1;
+	h->decimation_max = VLCGL_DECIMATE_DEFAULT;
+	h->decimation = 1;
+	h->gpu_us = -1;
+	h->gl_calls = -1;
+    h->vgl = vout_display_opengl_New (&h->fmt);
+
+// 	h->fmt.i_visible_width = width;
+// 	h->fmt.i_visible_height = height;
+
+// 	h->vgl->fmt.i_visible_width = width;
+// 	h->vgl->fmt.i_visible_height = height;
+
+
+    return h;
+
+fail:
+    opengl_close(h);
+
+	return NULL;
+}
+
+static double getDistance(OPENGL_HANDLE h, float x1, float y1, float x2, float y2)
+{
+	return sqrt((x1 - x2) * (x1 - x2) + (y1 - y2) * (y1 - y2));
+}
+
+/* Move a touch point of the surface (top left origin) into the viewport */
+static void ToView(OPENGL_HANDLE h, float *x, float *y)
+{
+	if (h->vgl == NULL || h->vgl->view[2] <= 0 || h->vgl->view[3] <= 0)
+	{
+		return;
+	}
+
+	const int *view = h->vgl->view;
+
+	*x -= view[0];
+	if (h->vgl->surface[1] > 0)
+	{
+		*y -= h->vgl->surface[1] - view[1] - view[3];
+	}
+}
+
+int opengl_scale_before(OPENGL_HANDLE h, float x1, float y1, float x2, float y2)
+{
+	ToView(h, &x1, &y1);
+	ToView(h, &x2, &y2);
+
+	h->x1 = x1;
+	h->y1 = y1;
+	h->x2 = x2;
+	h->y2 = y2;
+
+	h->distance = getDistance(h, x1, y1, x2, y2);
+
+	LOGI("opengl_scale_before: h: 0x%p, dis: %f, x1: %f, y1: %f,x2: %f, y2: %f", h, h->distance, x1, y1, x2, y2);
+
+	return 1;
+}
+
+int opengl_set_scale(OPENGL_HANDLE h, float scale1, float x1, float y1, float x2, float y2, 
+					 int surface_width, int surface_height)
+{
+
+	double scale = 0.0;
+
+	double cur_dis;
+
+	float off_x, off_y;
+
+	vout_display_opengl_t *		vgl = NULL;
+	if ((h == NULL) && (h->vgl == NULL))
+	{
+		return -1;
+	}
+	
+	vgl = h->vgl;
+
+	/* the pan is a fraction of the viewport, the surface until it is known */
+	int view_w = vgl->view[2] > 0 ? vgl->view[2] : surface_width;
+	int view_h = vgl->view[3] > 0 ? vgl->view[3] : surface_height;
+	ToView(h, &x1, &y1);
+	ToView(h, &x2, &y2);
+
+	cur_dis = getDistance(h, x1, y1, x2, y2);
+	scale =   h->distance / cur_dis;
+
+	off_x = fabs((x1 + x2) / 2 - (h->x1 + h->x2) / 2);
+	off_y = fabs((y1 + y2) / 2 - (h->y1 + h->y2) / 2);
+
+	h->scale *= scale;
+	h->distance = cur_dis;
+
+	h->off_x += off_x;
+	h->off_y += off_y;
+	
+	h->x1 = x1;
+	h->y1 = y1;
+	h->x2 = x2;
+	h->y2 = y2;
+
+
+	/* the square [l, l + scale] x [t, t + scale] of the picture fills the view */
+	float l = h->off_x / view_w;
+	float t = h->off_y / view_h;
+	float s = h->scale;
+	const float pinch[9] = {
+		1.0 / s,                 0.0,                     0.0,
+		0.0,                     1.0 / s,                 0.0,
+		(1.0 - 2.0 * l) / s - 1.0, 1.0 - (1.0 - 2.0 * t) / s, 1.0,
+	};
+	float transform[9];
+	MultiplyMatrix(transform, pinch, h->transform);
+	SetTransform(vgl, transform);
+
+
+	LOGI("scale: %f, view_w: %d, view_h: %d, off_x: %f, off_y: %f, visible: %f %f %f %f",
+			h->scale, view_w, view_h, h->off_x, h->off_y, 
+			vgl->visible[0], vgl->visible[1], vgl->visible[2], vgl->visible[3]);
+
+
+	return 1;
+
+}
+
+int opengl_set_transform(OPENGL_HANDLE h, const float *matrix)
+{
+	if ((h == NULL) || (h->vgl == NULL))
+	{
+		return -1;
+	}
+
+	/* the next pinch starts again from 1:1 on top of the new matrix */
+	static const float identity[9] = { 1, 0, 0,  0, 1, 0,  0, 0, 1 };
+	memcpy(h->transform, matrix ? matrix : identity, sizeof(h->transform));
+	h->scale = 1.0;
+	h->off_x = 0;
+	h->off_y = 0;
+
+	SetTransform(h->vgl, h->transform);
+
+	return 1;
+}
+
+/* Kept for the callers of JVO_SetOffset, the pan follows the pinch of
+ * opengl_set_scale or the matrix of opengl_set_transform */
+int opengl_set_offset(OPENGL_HANDLE h, int off_x, int off_y)
+{
+	if (h == NULL)
+	{
+		return -1;
+	}
+
+	return 1;
+}
+
+/* Place a width x height picture in the view rect after a resize or a mode
+ * change: the viewport shrinks around a fitted picture, a picture larger
+ * than the view is scaled past the viewport and clipped by it */
+static void ResolveDisplay(OPENGL_HANDLE h, unsigned int width, unsigned int height)
+{
+	const int *area = h->area;
+
+	if (!h->display_dirty && h->display_width == width && h->display_height == height)
+	{
+		return;
+	}
+	h->display_dirty = 0;
+	h->display_width = width;
+	h->display_height = height;
+
+	if (area[2] <= 0 || area[3] <= 0)
+	{
+		return;
+	}
+
+	/* a quarter turn lays the picture on its side */
+	if (h->rotation == 90 || h->rotation == 270)
+	{
+		unsigned int swap = width;
+		width = height;
+		height = swap;
+	}
+
+	/* size of the picture on screen */
+	float w = area[2];
+	float hgt = area[3];
+	if (width > 0 && height > 0 && h->display_mode != JVO_DISPLAY_STRETCH)
+	{
+		float ratio_w = (float)area[2] / width;
+		float ratio_h = (float)area[3] / height;
+		float scale = h->display_mode == JVO_DISPLAY_FIT ? fminf(ratio_w, ratio_h) :
+					  h->display_mode == JVO_DISPLAY_FILL ? fmaxf(ratio_w, ratio_h) : 1.0;
+		w = width * scale;
+		hgt = height * scale;
+	}
+
+	int view_w = w < area[2] ? (int)fmaxf(roundf(w), 1.0) : area[2];
+	int view_h = hgt < area[3] ? (int)fmaxf(roundf(hgt), 1.0) : area[3];
+	SetView(h->vgl, area[0] + (area[2] - view_w) / 2, area[1] + (area[3] - view_h) / 2,
+			view_w, view_h, h->surface[0], h->surface[1]);
+	SetDisplayScale(h->vgl, w > area[2] ? w / area[2] : 1.0,
+					hgt > area[3] ? hgt / area[3] : 1.0);
+
+	LOGI("display mode: %d, picture: %ux%u, view: %d %d %d %d, scale: %f %f",
+		 h->display_mode, width, height, h->vgl->view[0], h->vgl->view[1],
+		 view_w, view_h, h->vgl->display_scale[0], h->vgl->display_scale[1]);
+}
+
+/* Picture pixels per viewport pixel of a width x height picture, along the
+ * least shrunk axis; 0: unknown */
+static float GetMinification(OPENGL_HANDLE h, PVO_IN_YUV pic,
+							 unsigned int width, unsigned int height)
+{
+	const GLfloat *m = h->vgl->transform;
+	const int *view = h->vgl->view;
+	int view_w = view[2] > 0 ? view[2] : pic->i_visible_width;
+	int view_h = view[3] > 0 ? view[3] : pic->i_visible_height;
+
+	if (view_w <= 0 || view_h <= 0)
+	{
+		return 0.0;
+	}
+
+	/* viewport pixels covered by the width and the height of the picture,
+	 * larger when zoomed in, swapped when rotated */
+	float size_w = hypotf(m[0] * view_w, m[1] * view_h);
+	float size_h = hypotf(m[3] * view_w, m[4] * view_h);
+	if (size_w <= 0 || size_h <= 0)
+	{
+		return 0.0;
+	}
+
+	return fminf(width / size_w, height / size_h);
+}
+
+/* Luma filter of the texture size against the viewport: trilinear above
+ * 2x, bicubic from 1x to 2x */
+static int GetScaler(OPENGL_HANDLE h, PVO_IN_YUV pic)
+{
+	if (h->scale_quality != JVO_SCALE_QUALITY_AUTO)
+	{
+		return VLCGL_SCALER_BILINEAR;
+	}
+
+	float ratio = GetMinification(h, pic, h->fmt.i_width, h->fmt.i_height);
+
+	return ratio > 2.0 ? VLCGL_SCALER_MIPMAP :
+		   ratio > 1.0 ? VLCGL_SCALER_BICUBIC : VLCGL_SCALER_BILINEAR;
+}
+
+/* Box decimation for pictures much larger than the view, 1: none.
+ * Only the 8 bit planar 4:2:0 layouts are decimated. */
+static int GetDecimation(OPENGL_HANDLE h, PVO_IN_YUV pic, vlc_fourcc_t chroma)
+{
+	if (h->decimation_max <= 1 ||
+		(chroma != VLC_CODEC_I420 && chroma != VLC_CODEC_YV12 && chroma != VLC_CODEC_J420))
+	{
+		return 1;
+	}
+
+	float ratio = GetMinification(h, pic, pic->i_width, pic->i_height);
+	if (ratio <= 0.0)
+	{
+		return 1;
+	}
+
+	int decimation = ratio >= 4.0 && h->decimation_max >= 4 ? 4 : ratio >= 2.0 ? 2 : 1;
+
+	/* keep the textures usable for tiny pictures */
+	while (decimation > 1 &&
+		   (pic->i_width / decimation < 16 || pic->i_height / decimation < 16))
+	{
+		decimation /= 2;
+	}
+
+	/* a view resized around a threshold must not rebuild every frame */
+	if (decimation < h->decimation && h->decimation <= h->decimation_max &&
+		ratio >= h->decimation * VLCGL_DECIMATE_HYSTERESIS)
+	{
+		decimation = h->decimation;
+	}
+
+	return decimation;
+}
+
+/* Box filter pic down to the texture size, twice for 4x */
+static PVO_IN_YUV Decimate(OPENGL_HANDLE h, PVO_IN_YUV pic)
+{
+	vout_display_opengl_t *vgl = h->vgl;
+	int width[3], height[3], pitch[3];
+	int size = 0;
+	int tmp_pitch = 0;
+	unsigned j;
+
+	for (j = 0; j < 3; j++)
+	{
+		width[j]  = GetPlaneBytes(vgl, j);
+		height[j] = vgl->fmt.i_height * vgl->chroma->p[j].h.num / vgl->chroma->p[j].h.den;
+		pitch[j]  = ALIGN(width[j], COPY_BUFFER_ALIGN);
+		size += pitch[j] * height[j];
+	}
+	if (h->decimation == 4)
+	{
+		/* half way plane, the luma one is the largest */
+		tmp_pitch = ALIGN(2 * width[0], COPY_BUFFER_ALIGN);
+		size += tmp_pitch * 2 * height[0];
+	}
+
+	if (h->decimate_buf_size < size)
+	{
+		free(h->decimate_buf);
+		h->decimate_buf = memalign(COPY_BUFFER_ALIGN, size);
+		h->decimate_buf_size = h->decimate_buf ? size : 0;
+		if (h->decimate_buf == NULL)
+		{
+			return NULL;
+		}
+	}
+
+	uint8_t *dst = h->decimate_buf;
+	uint8_t *tmp = h->decimate_buf + size - tmp_pitch * 2 * height[0];
+
+	for (j = 0; j < 3; j++)
+	{
+		if (h->decimation == 4)
+		{
+			HalvePlane(tmp, tmp_pitch, pic->p[j].p_pixels, pic->p[j].i_pitch,
+					   2 * width[j], 2 * height[j]);
+			HalvePlane(dst, pitch[j], tmp, tmp_pitch, width[j], height[j]);
+		}
+		else
+		{
+			HalvePlane(dst, pitch[j], pic->p[j].p_pixels, pic->p[j].i_pitch,
+					   width[j], height[j]);
+		}
+		h->decimated.p[j].p_pixels = dst;
+		h->decimated.p[j].i_pitch = pitch[j];
+		dst += pitch[j] * height[j];
+	}
+	h->decimated.i_chroma = pic->i_chroma;
+	h->decimated.i_width = vgl->fmt.i_width;
+	h->decimated.i_height = vgl->fmt.i_height;
+	h->decimated.i_visible_width = pic->i_visible_width;
+	h->decimated.i_visible_height = pic->i_visible_height;
+
+	/* the caller rects are in picture rows */
+	for (int i = 0; i < h->dirty_rect_count; i++)
+	{
+		VO_RECT *r = &h->dirty_rects[i];
+		int y1 = (r->y + r->height + h->decimation - 1) / h->decimation;
+		r->x /= h->decimation;
+		r->y /= h->decimation;
+		r->width = (r->width + h->decimation - 1) / h->decimation;
+		r->height = y1 - r->y;
+	}
+
+	return &h->decimated;
+}
+
+/* Matrix and range of pic, guessed from its size and chroma when auto */
+static void GetColorimetry(PVO_IN_YUV pic, int *matrix, int *range)
+{
+	*matrix = pic->i_matrix;
+	if (*matrix < JVO_MATRIX_BT601 || *matrix > JVO_MATRIX_BT2020)
+	{
+		*matrix = pic->i_height > 576 ? JVO_MATRIX_BT709 : JVO_MATRIX_BT601;
+	}
+
+	*range = pic->i_range;
+	if (*range != JVO_RANGE_LIMITED && *range != JVO_RANGE_FULL)
+	{
+		*range = pic->i_chroma == VLC_CODEC_J420 ? JVO_RANGE_FULL : JVO_RANGE_LIMITED;
+	}
+}
+
+/* Chroma of the picture, the callers that never set it get YV12 */
+static vlc_fourcc_t GetInputChroma(PVO_IN_YUV pic)
+{
+	switch (pic->i_chroma)
+	{
+	case VLC_CODEC_I420:
+	case VLC_CODEC_YV12:
+	case VLC_CODEC_J420:
+	case VLC_CODEC_NV12:
+	case VLC_CODEC_NV21:
+	case VLC_CODEC_YUYV:
+	case VLC_CODEC_YVYU:
+	case VLC_CODEC_UYVY:
+	case VLC_CODEC_VYUY:
+	case VLC_CODEC_I420_10L:
+	case VLC_CODEC_I420_9L:
+		return pic->i_chroma;
+	default:
+		return VLC_CODEC_YV12;
+	}
+}
+
+/* gl calls counted since the frame started, -1 in release builds */
+static int GetFrameCalls(vout_display_opengl_t *vgl)
+{
+#ifndef NDEBUG
+	return vgl->state->calls;
+#else
+	(void)vgl;
+	return -1;
+#endif
+}
+
+int opengl_do(OPENGL_HANDLE h, PVO_IN_YUV pic)
+{
+
+	vout_display_opengl_t *		vgl = NULL;
+	if ((h == NULL) && (h->vgl == NULL))
+	{
+		return -1;
+	}
 
-//	LOGI("max_texture_units = %d, supports_shaders: %d",max_texture_units, supports_shaders);
+	vgl = h->vgl;
+	vgl->state->calls = 0;
 
-    if (max_texture_units >= 3 && supports_shaders && vlc_fourcc_IsYUV(fmt->i_chroma)) {
-        const vlc_fourcc_t *list = vlc_fourcc_GetYUVFallback(fmt->i_chroma);
-        while (*list) {
-            const vlc_chroma_description_t *dsc = vlc_fourcc_GetChromaDescription(*list);
-            if (dsc && dsc->plane_count == 3 && dsc->pixel_size == 1) {
-                vgl->fmt          = *fmt;
-                vgl->fmt.i_chroma = *list;
-                vgl->tex_format   = GL_LUMINANCE;
-                vgl->tex_internal = GL_LUMINANCE;
-                vgl->tex_type     = GL_UNSIGNED_BYTE;
-                break;
-            }
-            list++;
-        }
-    }
-    
+	if (vgl->texture_count != h->texture_count)
+	{
+		/* the texture sets are rebuilt with the new depth below */
+		PoolPark(vgl);
+		vgl->texture_count = h->texture_count;
+		h->src_width = 0;
+	}
 
-    vgl->chroma = vlc_fourcc_GetChromaDescription(vgl->fmt.i_chroma);
-    vgl->use_multitexture = vgl->chroma->plane_count > 1;
-   
-    /* Texture size */
-    for (unsigned j = 0; j < vgl->chroma->plane_count; j++) {
-        int w = vgl->fmt.i_width  * vgl->chroma->p[j].w.num / vgl->chroma->p[j].w.den;
-        int h = vgl->fmt.i_height * vgl->chroma->p[j].h.num / vgl->chroma->p[j].h.den;
-        if (vgl->supports_npot) {
-            vgl->tex_width[j]  = w;
-            vgl->tex_height[j] = h;
-        } else {
-            vgl->tex_width[j]  = GetAlignedSize(w);
-            vgl->tex_height[j] = GetAlignedSize(h);
-        }
+	if (vgl->dirty_band_height != h->dirty_band_height)
+	{
+		ResetDirty(vgl);
+		vgl->dirty_band_height = h->dirty_band_height;
+	}
+	
+	ResolveDisplay(h, pic->i_width, pic->i_height);
 
+	vlc_fourcc_t chroma = GetInputChroma(pic);
+	int decimation = GetDecimation(h, pic, chroma);
+	GetColorimetry(pic, &h->fmt.i_matrix, &h->fmt.i_range);
+	if (h->src_width != pic->i_width || h->src_height != pic->i_height ||
+		h->fmt.i_chroma != chroma || h->decimation != decimation)
+	{
+	//	LOGI("1 opengl_do h->fmt.i_width ! = pic->i_width %d != %d , BuildTexture",
+	//								h->fmt.i_width, pic->i_width);
+		/* new textures, nothing to draw again until they are filled */
+		h->last_draw = OPENGL_DRAW_NONE;
+		h->src_width = pic->i_width;
+		h->src_height = pic->i_height;
+		h->decimation = decimation;
+		h->fmt.i_width = pic->i_width / decimation;
+		h->fmt.i_height = pic->i_height / decimation;
+		h->fmt.i_chroma = chroma;
+		if (BuildTexture(h->vgl, &h->fmt) < 0)
+		{
+			h->src_width = 0;
+			return -1;
+		}
     }
 
-    for (int i = 0; i < VLCGL_TEXTURE_COUNT; i++) {
-        glGenTextures(vgl->chroma->plane_count, vgl->texture[i]);
-        for (unsigned j = 0; j < vgl->chroma->plane_count; j++) {
-            if (vgl->use_multitexture) {
-                glActiveTexture(GL_TEXTURE0 + j);
-                glClientActiveTexture(GL_TEXTURE0 + j);
-            }
-            glBindTexture(vgl->tex_target, vgl->texture[i][j]);
+	/* colorimetry switches only reload the Coefficient uniform */
+	if (vgl->fmt.i_matrix != h->fmt.i_matrix || vgl->fmt.i_range != h->fmt.i_range)
+	{
+		vgl->fmt.i_matrix = h->fmt.i_matrix;
+		vgl->fmt.i_range = h->fmt.i_range;
+		BuildCoefficients(vgl, &vgl->fmt);
+	}
 
+	if (SetScaler(vgl, GetScaler(h, pic)) < 0)
+	{
+		return -1;
+	}
+	
+	UpdatePBO(vgl, h->pbo_count);
 
-            glTexParameteri(vgl->tex_target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-            glTexParameteri(vgl->tex_target, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-            glTexParameteri(vgl->tex_target, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-            glTexParameteri(vgl->tex_target, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	h->gpu_us = TimerPoll(vgl);
+	TimerBegin(vgl);
 
-            /* Call glTexImage2D only once, and use glTexSubImage2D later */
-            glTexImage2D(vgl->tex_target, 0,
-                         vgl->tex_internal, vgl->tex_width[j], vgl->tex_height[j],
-                         0, vgl->tex_format, vgl->tex_type, NULL);
-        }
-    }
+	int64_t start = opengl_mdate();
+	if (h->decimation > 1)
+	{
+		pic = Decimate(h, pic);
+		if (pic == NULL)
+		{
+			TimerEnd(vgl);
+			return -1;
+		}
+	}
+    vout_display_opengl_Prepare(vgl, pic,
+                                h->dirty_rect_count >= 0 ? h->dirty_rects : NULL,
+                                h->dirty_rect_count);
+	h->dirty_rect_count = -1;
+	UpdateMipmaps(vgl);
+	h->upload_us = (int)(opengl_mdate() - start);
 
-    *fmt = vgl->fmt;
+	start = opengl_mdate();
+	ClearBackground(vgl);
+
+	DrawWithShaders(vgl, vgl->left, vgl->top, vgl->right, vgl->bottom);
+	TimerEnd(vgl);
+	h->draw_us = (int)(opengl_mdate() - start);
+	h->gl_calls = GetFrameCalls(vgl);
+	h->last_draw = OPENGL_DRAW_PICTURE;
 
 	return 1;
 }
 
-typedef struct _OPENGL
+int opengl_do_image(OPENGL_HANDLE h, void *image, unsigned int width, unsigned int height)
 {
-	video_format_t 				fmt;
-	vout_display_opengl_t *		vgl;
-	double						distance;
-	float						x1;
-	float						y1;
-	float						x2;
-	float						y2;
-	float						scale;
-	float						off_x;
-	float						off_y;
-}OPENGL, *POPENGL;
+	vout_display_opengl_t *		vgl = NULL;
+	if ((h == NULL) || (h->vgl == NULL) || (image == NULL))
+	{
+		return -1;
+	}
 
+	vgl = h->vgl;
+	vgl->state->calls = 0;
 
+	ResolveDisplay(h, width, height);
 
+	h->gpu_us = TimerPoll(vgl);
+	TimerBegin(vgl);
 
-OPENGL_HANDLE opengl_open(int width, int height)
-{
+	int64_t start = opengl_mdate();
+	if (vout_display_opengl_PrepareImage(vgl, image) < 0)
+	{
+		TimerEnd(vgl);
+		return -1;
+	}
+	vgl->upload_bytes = 0;
+	h->upload_us = (int)(opengl_mdate() - start);
 
-	OPENGL_HANDLE h = NULL;
+	start = opengl_mdate();
+	ClearBackground(vgl);
 
-    h = malloc(sizeof(OPENGL));
-    if (h == NULL)
-    {
-    	goto fail;
-    }
-    memset(h, 0, sizeof(OPENGL));
+	DrawImage(vgl);
+	TimerEnd(vgl);
+	h->draw_us = (int)(opengl_mdate() - start);
+	h->gl_calls = GetFrameCalls(vgl);
+	h->last_draw = OPENGL_DRAW_IMAGE;
 
-    memset(&h->fmt, 0, sizeof(video_format_t));
-	
-	h->scale = 1.0;
-    h->vgl = vout_display_opengl_New (&h->fmt);
+	return 1;
+}
 
-// 	h->fmt.i_visible_width = width;
-// 	h->fmt.i_visible_height = height;
+/* Draw the last picture or image again from the resident textures with the
+ * current view and transform, nothing is uploaded. The first call stops the
+ * cropped uploads, the next pictures fill the whole textures so that any
+ * zoom or pan can be drawn again from them. */
+int opengl_redraw(OPENGL_HANDLE h)
+{
+	vout_display_opengl_t *		vgl = NULL;
+	if ((h == NULL) || (h->vgl == NULL))
+	{
+		return -1;
+	}
 
-// 	h->vgl->fmt.i_visible_width = width;
-// 	h->vgl->fmt.i_visible_height = height;
+	h->vgl->crop_upload = 0;
+	if (h->last_draw == OPENGL_DRAW_NONE)
+	{
+		return -1;
+	}
 
+	vgl = h->vgl;
+	vgl->state->calls = 0;
 
-    return h;
+	ResolveDisplay(h, h->display_width, h->display_height);
 
-fail:
-    opengl_close(h);
+	if (h->last_draw == OPENGL_DRAW_PICTURE)
+	{
+		/* the view is set by now, the picture size is not needed */
+		VO_IN_YUV none;
 
-	return NULL;
-}
+		memset(&none, 0, sizeof(none));
+		if (SetScaler(vgl, GetScaler(h, &none)) < 0)
+		{
+			return -1;
+		}
+	}
 
-float g_scale_w = 0.0;
-float g_scale_h = 0.0;
-int g_x_offset = 0;
-int g_y_offset = 0;
+	h->gpu_us = TimerPoll(vgl);
+	TimerBegin(vgl);
 
-int frame_count = 0;
+	vgl->upload_bytes = 0;
+	h->upload_us = 0;
 
-float g_scale = 0.0;
+	int64_t start = opengl_mdate();
+	if (h->last_draw == OPENGL_DRAW_PICTURE)
+	{
+		UpdateMipmaps(vgl);
+		ClearBackground(vgl);
+		DrawWithShaders(vgl, vgl->left, vgl->top, vgl->right, vgl->bottom);
+	}
+	else
+	{
+		ClearBackground(vgl);
+		DrawImage(vgl);
+	}
+	TimerEnd(vgl);
+	h->draw_us = (int)(opengl_mdate() - start);
+	h->gl_calls = GetFrameCalls(vgl);
 
-static double getDistance(OPENGL_HANDLE h, float x1, float y1, float x2, float y2)
+	return 1;
+}
+
+void opengl_close(OPENGL_HANDLE h)
 {
-	return sqrt((x1 - x2) * (x1 - x2) + (y1 - y2) * (y1 - y2));
+	if (h == NULL)
+	{
+		return;
+	}
+
+	vout_display_opengl_Delete(h->vgl);
+
+	free(h->dirty_rects);
+	free(h->decimate_buf);
+	free(h);
 }
 
-int opengl_scale_before(OPENGL_HANDLE h, float x1, float y1, float x2, float y2)
+int opengl_set_pbo(OPENGL_HANDLE h, int count)
 {
-	h->x1 = x1;
-	h->y1 = y1;
-	h->x2 = x2;
-	h->y2 = y2;
+	if (h == NULL)
+	{
+		return -1;
+	}
 
-	h->distance = getDistance(h, x1, y1, x2, y2);
+	if (count < 0 || count > VLCGL_PBO_MAX)
+	{
+		return -1;
+	}
 
-	LOGI("opengl_scale_before: h: 0x%p, dis: %f, x1: %f, y1: %f,x2: %f, y2: %f", h, h->distance, x1, y1, x2, y2);
+	/* applied by the next opengl_do, from the rendering thread */
+	h->pbo_count = count;
 
 	return 1;
 }
 
-int opengl_set_scale(OPENGL_HANDLE h, float scale1, float x1, float y1, float x2, float y2, 
-					 int i_visible_width, int i_visible_height)
+int opengl_set_texture_count(OPENGL_HANDLE h, int count)
 {
+	if (h == NULL)
+	{
+		return -1;
+	}
 
-	double scale = 0.0;
-	unsigned int j;
+	if (count < 1 || count > VLCGL_TEXTURE_MAX)
+	{
+		return -1;
+	}
 
-	double cur_dis;
+	h->texture_count = count;
 
-	float off_x, off_y;
+	return 1;
+}
 
-	vout_display_opengl_t *		vgl = NULL;
-	if ((h == NULL) && (h->vgl == NULL))
+int opengl_set_dirty_upload(OPENGL_HANDLE h, int band_height)
+{
+	if ((h == NULL) || (band_height < 0))
 	{
 		return -1;
 	}
-	
-	vgl = h->vgl;
 
-	cur_dis = getDistance(h, x1, y1, x2, y2);
-	scale =   h->distance / cur_dis;
+	/* whole chroma rows per band, for every subsampling */
+	h->dirty_band_height = ALIGN(band_height, 16);
 
-	off_x = fabs((x1 + x2) / 2 - (h->x1 + h->x2) / 2);
-	off_y = fabs((y1 + y2) / 2 - (h->y1 + h->y2) / 2);
+	return 1;
+}
 
-	h->scale *= scale;
-	h->distance = cur_dis;
+int opengl_set_decimation(OPENGL_HANDLE h, int max_factor)
+{
+	if ((h == NULL) || (max_factor != 1 && max_factor != 2 && max_factor != 4))
+	{
+		return -1;
+	}
 
-	h->off_x += off_x;
-	h->off_y += off_y;
-	
-	h->x1 = x1;
-	h->y1 = y1;
-	h->x2 = x2;
-	h->y2 = y2;
+	/* applied by the next opengl_do, from the rendering thread */
+	h->decimation_max = max_factor;
 
+	return 1;
+}
 
-	for (j = 0; j < vgl->chroma->plane_count; j++)
-	{	
-		vgl->left[j]   = h->off_x / i_visible_width;
-		vgl->top[j]    = h->off_y / i_visible_height; 
-		vgl->right[j]  = vgl->left[j] + h->scale;
-		vgl->bottom[j] = vgl->top[j] + h->scale;
+int opengl_set_scale_quality(OPENGL_HANDLE h, int quality)
+{
+	if ((h == NULL) ||
+		(quality != JVO_SCALE_QUALITY_BILINEAR && quality != JVO_SCALE_QUALITY_AUTO))
+	{
+		return -1;
 	}
 
-
-	LOGI("scale: %f, i_visible_width: %d, i_visible_height: %d, off_x: %f, off_y: %f, l: %f, t: %f, r: %f, b: %f",
-			h->scale, i_visible_width, i_visible_height, h->off_x, h->off_y, 
-			vgl->left[0], vgl->top[0], vgl->right[0], vgl->bottom[0]);
-
+	/* applied by the next opengl_do, from the rendering thread */
+	h->scale_quality = quality;
 
 	return 1;
-
 }
 
-int opengl_set_offset(OPENGL_HANDLE h, int off_x, int off_y)
+int opengl_set_program_cache(const char *dir)
 {
-// 	vout_display_opengl_t *		vgl = NULL;
-// 	if ((h == NULL) && (h->vgl == NULL))
-// 	{
-// 		return -1;
-// 	}
-// 	
-// 	vgl = h->vgl;
-// 
-// 	h->fmt.i_x_offset -= off_x;
-// 	h->fmt.i_y_offset -= off_y;
-// 
-// 	unsigned int j;
-// 	
-// 	for (j = 0; j < vgl->chroma->plane_count; j++)
-// 	{	
-// 		vgl->left[j]   = (h->fmt.i_x_offset +                       0 ) * vgl->scale_w[j];
-// 		vgl->top[j]    = (h->fmt.i_y_offset +                       0 ) * vgl->scale_h[j];
-// 		vgl->right[j]  = (h->fmt.i_x_offset + h->fmt.i_width ) * vgl->scale_w[j];
-// 		vgl->bottom[j] = (h->fmt.i_y_offset + h->fmt.i_height) * vgl->scale_h[j];
-// 		
-// // 		LOGI("scale_w: %f, scale_h: %f, x: %d, y: %d, l: %f, t: %f, r: %f, b: %f",
-// // 			vgl->scale_w[j], vgl->scale_h[j], h->fmt.i_x_offset, h->fmt.i_y_offset,
-// // 			vgl->left[j], vgl->top[j], vgl->right[j], vgl->bottom[j]);
-// 	}
+	char *copy = NULL;
+
+	if (dir != NULL)
+	{
+		copy = strdup(dir);
+		if (copy == NULL)
+		{
+			return -1;
+		}
+	}
+
+	pthread_mutex_lock(&program_cache_lock);
+	free(program_binary_dir);
+	program_binary_dir = copy;
+	pthread_mutex_unlock(&program_cache_lock);
 
 	return 1;
 }
 
-int opengl_do(OPENGL_HANDLE h, PVO_IN_YUV pic)
+int opengl_set_dirty_rects(OPENGL_HANDLE h, const VO_RECT *rects, int count)
 {
-
-	vout_display_opengl_t *		vgl = NULL;
-	if ((h == NULL) && (h->vgl == NULL))
+	if ((h == NULL) || (count < 0) || (count > 0 && rects == NULL))
 	{
 		return -1;
 	}
 
-	vgl = h->vgl;
-	
-	if (h->fmt.i_width != pic->i_width)
+	if (count > h->dirty_rect_max)
 	{
-	//	LOGI("1 opengl_do h->fmt.i_width ! = pic->i_width %d != %d , BuildTexture",
-	//								h->fmt.i_width, pic->i_width);
-		h->fmt.i_width = pic->i_width;
-		h->fmt.i_height = pic->i_height;
-		h->fmt.i_chroma = VLC_CODEC_YV12;
-		BuildTexture(h->vgl, &h->fmt);
-		
-// 		h->fmt.i_x_offset += 10;
-// 		h->fmt.i_y_offset += 10;
-
-		unsigned int j;
-
-		for (j = 0; j < vgl->chroma->plane_count; j++)
+		VO_RECT *p = realloc(h->dirty_rects, count * sizeof(VO_RECT));
+		if (p == NULL)
 		{
-            vgl->scale_w[j] = (float)vgl->chroma->p[j].w.num / vgl->chroma->p[j].w.den / vgl->tex_width[j];
-            vgl->scale_h[j] = (float)vgl->chroma->p[j].h.num / vgl->chroma->p[j].h.den / vgl->tex_height[j];
-
-// 			float scale = 1.2;
-// 
-// 			vgl->scale_w[j] *= scale;
-// 			vgl->scale_h[j] *= scale;
-
-			vgl->left[j]   = (h->fmt.i_x_offset +              0 ) * vgl->scale_w[j];
-			vgl->top[j]    = (h->fmt.i_y_offset +              0 ) * vgl->scale_h[j];
-			vgl->right[j]  = (h->fmt.i_x_offset + h->fmt.i_width) * vgl->scale_w[j];
-			vgl->bottom[j] = (h->fmt.i_y_offset + h->fmt.i_height) * vgl->scale_h[j];
-			
-			
-			g_scale_w = vgl->scale_w[0];
-			g_scale_h = vgl->scale_h[0];
+			return -1;
 		}
+		h->dirty_rects = p;
+		h->dirty_rect_max = count;
+	}
 
-// 		LOGI("1scale_w: %f, scale_h: %f, x: %d, y: %d, l: %f, t: %f, r: %f, b: %f",
-// 			vgl->scale_w[j], vgl->scale_h[j], h->fmt.i_x_offset, h->fmt.i_y_offset,
-// 			vgl->left[0], vgl->top[0], vgl->right[0], vgl->bottom[0]);
+	if (count > 0)
+	{
+		memcpy(h->dirty_rects, rects, count * sizeof(VO_RECT));
+	}
+	h->dirty_rect_count = count;
 
-    }
-	
-    vout_display_opengl_Prepare(vgl, pic);
+	return 1;
+}
 
-	glClear(GL_COLOR_BUFFER_BIT);
+int opengl_get_stats(OPENGL_HANDLE h, PVO_STATS stats)
+{
+	if ((h == NULL) || (h->vgl == NULL))
+	{
+		return -1;
+	}
 
-	DrawWithShaders(vgl, vgl->left, vgl->top, vgl->right, vgl->bottom);
+	stats->i_upload_us = h->upload_us;
+	stats->i_draw_us = h->draw_us;
+	stats->i_gpu_us = h->gpu_us;
+	stats->i_pbo_count = h->vgl->pbo_count;
+	stats->i_texture_count = h->vgl->texture_count;
+	stats->i_upload_bytes = h->vgl->upload_bytes;
+	stats->i_gl_calls = h->gl_calls;
+
+	return 1;
+}
+
+int64_t opengl_mdate(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+int opengl_set_view(OPENGL_HANDLE h, int left, int top, int width, int height,
+					int surface_width, int surface_height)
+{
+	if ((h == NULL) || (h->vgl == NULL))
+	{
+		return -1;
+	}
 
+	h->area[0] = left;
+	h->area[1] = top;
+	h->area[2] = width;
+	h->area[3] = height;
+	h->surface[0] = surface_width;
+	h->surface[1] = surface_height;
+	h->display_dirty = 1;
 
 	return 1;
 }
 
-void opengl_close(OPENGL_HANDLE h)
+int opengl_set_orientation(OPENGL_HANDLE h, int degrees, int mirror)
 {
-	if (h == NULL)
+	if ((h == NULL) || (h->vgl == NULL) ||
+		(degrees != 0 && degrees != 90 && degrees != 180 && degrees != 270))
 	{
-		return;
+		return -1;
 	}
 
-	vout_display_opengl_Delete(h->vgl);
+	/* the pinch zoom and the pan stay in view space, on top of it */
+	SetOrientation(h->vgl, degrees, mirror != 0);
+	if (h->rotation != degrees)
+	{
+		h->rotation = degrees;
+		h->display_dirty = 1;
+	}
 
-	free(h);
+	return 1;
 }
 
-void opengl_set_view(int left, int top, int width, int height)
+int opengl_set_display_mode(OPENGL_HANDLE h, int mode)
 {
-	glViewport(left, top, width, height);
+	if ((h == NULL) || (h->vgl == NULL) ||
+		(mode < JVO_DISPLAY_STRETCH) || (mode > JVO_DISPLAY_NATIVE))
+	{
+		return -1;
+	}
+
+	if (h->display_mode != mode)
+	{
+		h->display_mode = mode;
+		h->display_dirty = 1;
+	}
+
+	return 1;
 }
 
-void opengl_clearcolor(float red, float green, float blue, float alpha)
+int opengl_clearcolor(OPENGL_HANDLE h, float red, float green, float blue, float alpha)
 {
+	if ((h == NULL) || (h->vgl == NULL))
+	{
+		return -1;
+	}
+
+	/* the whole surface, not the bars of the last frame */
+	StateScissorTest(h->vgl->state, 0);
 	glClearColor(red, green, blue, alpha);
 	glClear(GL_COLOR_BUFFER_BIT);
+
+	return 1;
 }
 
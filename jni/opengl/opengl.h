@@ -1,19 +1,35 @@
 #ifndef _OPENGL_H
 #define	_OPENGL_H
+#include <stdint.h>
 #include "../JVideoOut.h"
 
 typedef struct _OPENGL*  OPENGL_HANDLE;
 
 OPENGL_HANDLE opengl_open(int width, int height);
 int opengl_do(OPENGL_HANDLE h, PVO_IN_YUV pic);
+int opengl_do_image(OPENGL_HANDLE h, void *image, unsigned int width, unsigned int height);
+int opengl_redraw(OPENGL_HANDLE h);
 void opengl_close(OPENGL_HANDLE h);
 
 int opengl_scale_before(OPENGL_HANDLE h, float x1, float y1, float x2, float y2);
 int opengl_set_scale(OPENGL_HANDLE h, float scale, float x1, float y1, float x2, float y2,
-					 int i_visible_width, int i_visible_height);
+					 int surface_width, int surface_height);
 int opengl_set_offset(OPENGL_HANDLE h, int off_x, int off_y);
-void opengl_set_view(int left, int top, int width, int height);
-void opengl_clearcolor(float red, float green, float blue, float alpha);
+int opengl_set_transform(OPENGL_HANDLE h, const float *matrix);
+int opengl_set_orientation(OPENGL_HANDLE h, int degrees, int mirror);
+int opengl_set_pbo(OPENGL_HANDLE h, int count);
+int opengl_set_texture_count(OPENGL_HANDLE h, int count);
+int opengl_set_dirty_upload(OPENGL_HANDLE h, int band_height);
+int opengl_set_decimation(OPENGL_HANDLE h, int max_factor);
+int opengl_set_scale_quality(OPENGL_HANDLE h, int quality);
+int opengl_set_program_cache(const char *dir);
+int opengl_set_dirty_rects(OPENGL_HANDLE h, const VO_RECT *rects, int count);
+int opengl_get_stats(OPENGL_HANDLE h, PVO_STATS stats);
+int64_t opengl_mdate(void);
+int opengl_set_view(OPENGL_HANDLE h, int left, int top, int width, int height,
+					int surface_width, int surface_height);
+int opengl_set_display_mode(OPENGL_HANDLE h, int mode);
+int opengl_clearcolor(OPENGL_HANDLE h, float red, float green, float blue, float alpha);
 
 #endif // _OPENGL_H
 